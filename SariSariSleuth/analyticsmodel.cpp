@@ -1,4 +1,5 @@
 #include "analyticsmodel.h"
+#include "trace.h"
 #include <QDateTime>
 #include <algorithm>
 
@@ -19,81 +20,75 @@ QVariant AnalyticsModel::data(const QModelIndex &index, int role) const {
     if (!index.isValid() || index.row() >= analyticsData.size())
         return QVariant();
 
-    if (role == Qt::DisplayRole) {
-        const ProductAnalytics &analytics = analyticsData[index.row()];
-        return QString("%1 - Sold: %2 (Rate: %3/day)")
-            .arg(analytics.productName)
-            .arg(analytics.totalSold)
-            .arg(QString::number(analytics.salesRate, 'f', 2));
+    const ProductAnalytics &analytics = analyticsData[index.row()];
+    switch (role) {
+        case Qt::DisplayRole:
+            return QString("%1 - Sold: %2 (Rate: %3/day)")
+                .arg(analytics.productName)
+                .arg(analytics.totalSold)
+                .arg(QString::number(analytics.salesRate, 'f', 2));
+        case ProductNameRole: return analytics.productName;
+        case TotalSoldRole: return analytics.totalSold;
+        case SalesRateRole: return analytics.salesRate; // Full precision, unlike the display string
+        default: return QVariant();
     }
-    return QVariant();
 }
 
-void AnalyticsModel::updateAnalytics(const QVector<ConfirmedTransaction>& transactions, TimePeriod period) {
+void AnalyticsModel::setAnalytics(const QVector<ProductAnalytics>& analytics, TimePeriod period) {
 
-    // Called by onTimePeriodChanged
+    // Called by MainWindow once the worker is done, see onAnalyticsReady
 
     beginResetModel();
     currentPeriod = period;
-    calculateAnalytics(transactions);
+    analyticsData = analytics;
     endResetModel();
 }
 
-void AnalyticsModel::calculateAnalytics(const QVector<ConfirmedTransaction>& transactions) {
+QVector<ProductAnalytics> AnalyticsModel::calculateAnalytics(const SalesRollup& rollup, TimePeriod period, const QDateTime& now,
+                                                             const std::atomic<bool>* cancelled) {
+    SARI_TRACE_SCOPE("AnalyticsModel::calculateAnalytics");
 
-    // Called by upateAnalytics
+    // Called on a worker thread by MainWindow::refreshAnalytics, and by sarisari_bench
 
-    QDateTime now = QDateTime::currentDateTime();
-    QDateTime cutoff;
+    int periodDays = 7;
     
-    // Set cutoff date based on current period
-    switch (currentPeriod) {
+    // Set the period length based on current period
+    switch (period) {
         case TimePeriod::LastWeek:
-            cutoff = now.addDays(-7);
+            periodDays = 7;
             break;
         case TimePeriod::LastMonth:
-            cutoff = now.addDays(-30);
+            periodDays = 30;
             break;
         case TimePeriod::LastYear:
-            cutoff = now.addDays(-365);
+            periodDays = 365;
             break;
     }
 
-    // Map to store product analytics
-    QMap<QString, ProductAnalytics> productMap;
-
-    // Process transactions within the time period
-    for (const ConfirmedTransaction &transaction : transactions) {
-        if (transaction.timestamp >= cutoff) {
-            QString productName = transaction.item.productName;
-            
-            if (!productMap.contains(productName)) {
-                ProductAnalytics analytics;
-                analytics.productName = productName;
-                analytics.totalSold = 0;
-                analytics.timePeriodDays = (currentPeriod == TimePeriod::LastWeek) ? 7 :
-                                         (currentPeriod == TimePeriod::LastMonth) ? 30 : 365;
-                productMap[productName] = analytics;
-            }
-            
-            productMap[productName].totalSold += transaction.quantity;
-        }
-    }
+    // The rollup works in whole days, so the day of the cutoff counts in full
+    QDate firstDay = now.addDays(-periodDays).date();
+    const QVector<QPair<QString, int>> totals = rollup.totalsSince(firstDay);
+    if (cancelled && cancelled->load())
+        return QVector<ProductAnalytics>();
 
     // Calculate sales rates and convert to vector
-    analyticsData.clear();
-
-    // I'm pretty sure the type of i here is QMap<QString, ProductAnalytics>::iterator but
-    // its easier to type auto HAAHAHHAHAAH
-    for (auto i = productMap.begin(); i != productMap.end(); i++) {
-        ProductAnalytics &analytics = i.value();
+    QVector<ProductAnalytics> analyticsData;
+    analyticsData.reserve(totals.size());
+    for (const QPair<QString, int> &total : totals) {
+        ProductAnalytics analytics;
+        analytics.productName = total.first;
+        analytics.totalSold = total.second;
+        analytics.timePeriodDays = periodDays;
         analytics.salesRate = static_cast<double>(analytics.totalSold) / analytics.timePeriodDays;
         analyticsData.append(analytics);
     }
 
-    // Sort by sales rate (highest first)
+    // Sort by sales rate (highest first), ties by name since the rollup's hash has no order of its own
     std::sort(analyticsData.begin(), analyticsData.end(),
               [](const ProductAnalytics &a, const ProductAnalytics &b) { // Woohoo, lambda expression ni
-                  return a.salesRate > b.salesRate;
+                  if (a.salesRate != b.salesRate)
+                      return a.salesRate > b.salesRate;
+                  return a.productName < b.productName;
               });
+    return analyticsData;
 } 
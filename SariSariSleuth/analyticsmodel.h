@@ -3,7 +3,9 @@
 
 #include <QAbstractListModel>
 #include <QVector>
-#include "confirmedtransactionmodel.h"
+#include <QDateTime>
+#include <atomic>
+#include "salesrollup.h"
 
 enum class TimePeriod {
     LastWeek,
@@ -24,9 +26,14 @@ class AnalyticsModel : public QAbstractListModel {
     private:
         QVector<ProductAnalytics> analyticsData;
         TimePeriod currentPeriod;
-        void calculateAnalytics(const QVector<ConfirmedTransaction>& transactions);
 
     public:
+        enum AnalyticsRole { // Typed access to a row, instead of parsing the display string
+            ProductNameRole = Qt::UserRole + 1,
+            TotalSoldRole,
+            SalesRateRole
+        };
+
         explicit AnalyticsModel(QObject *parent = nullptr);
 
     // Required overrides for QAbstractListModel
@@ -34,8 +41,14 @@ class AnalyticsModel : public QAbstractListModel {
         QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
     // Custom methods
-        void updateAnalytics(const QVector<ConfirmedTransaction>& transactions, TimePeriod period);
+        void setAnalytics(const QVector<ProductAnalytics>& analytics, TimePeriod period); // Swaps in a finished result with one reset
+
+        // Doesn't touch the model, so it can run on a worker thread against a copy of the rollup.
+        // Returns early with nothing once cancelled is set.
+        static QVector<ProductAnalytics> calculateAnalytics(const SalesRollup& rollup, TimePeriod period, const QDateTime& now,
+                                                            const std::atomic<bool>* cancelled = nullptr);
         void setTimePeriod(TimePeriod period);
+        const QVector<ProductAnalytics> &getAnalytics() const { return analyticsData; }
 };
 
 #endif // ANALYTICSMODEL_H 
@@ -0,0 +1,63 @@
+#include "analyticsscheduler.h"
+
+// CONSTRUCTOR
+AnalyticsScheduler::AnalyticsScheduler(int intervalMs, QObject *parent)
+    : QObject(parent)
+    , dirty(false)
+    , visible(false)
+    , requested(0)
+    , coalesced(0)
+    , executed(0)
+{
+    throttle.setSingleShot(true);
+    throttle.setInterval(intervalMs);
+    connect(&throttle, &QTimer::timeout, this, &AnalyticsScheduler::run);
+}
+
+void AnalyticsScheduler::markDirty() {
+
+    // Called by the history and stock model signals, see the MainWindow constructor
+
+    requested++;
+    if (dirty) {
+        coalesced++; // Already waiting for a refresh, this one rides along
+    }
+    dirty = true;
+    if (visible && !throttle.isActive()) {
+        throttle.start();
+    }
+}
+
+void AnalyticsScheduler::setVisible(bool isVisible) {
+
+    // Called when the stacked widget switches pages
+
+    visible = isVisible;
+    if (!visible) {
+        throttle.stop(); // Nobody's looking, the refresh waits until the tab comes back
+    } else if (dirty) {
+        throttle.start(0); // Next turn of the event loop, after the page is shown
+    }
+}
+
+void AnalyticsScheduler::refreshNow() {
+
+    // Called by onTimePeriodChanged, the user is looking at the tab and waiting
+
+    throttle.stop();
+    if (dirty) {
+        coalesced++; // The pending refresh is covered by this one
+    }
+    dirty = true;
+    requested++;
+    run();
+}
+
+void AnalyticsScheduler::run() {
+    if (!dirty) {
+        return;
+    }
+    dirty = false;
+    executed++;
+    emit refreshRequested();
+}
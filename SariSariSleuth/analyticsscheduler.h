@@ -0,0 +1,39 @@
+#ifndef ANALYTICSSCHEDULER_H
+#define ANALYTICSSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+
+// Decides when the analytics get recomputed. Changes only mark them stale, and a burst of
+// changes ends up as one refresh, at most one per throttle interval, and none at all
+// while the analytics tab isn't on screen.
+class AnalyticsScheduler : public QObject {
+    Q_OBJECT
+
+    private:
+        QTimer throttle;
+        bool dirty; // Something changed since the last refresh
+        bool visible; // The analytics tab is the current page
+
+        quint64 requested; // markDirty calls
+        quint64 coalesced; // markDirty calls folded into a refresh that was already pending
+        quint64 executed; // Refreshes actually run
+
+        void run();
+
+    public:
+        explicit AnalyticsScheduler(int intervalMs, QObject *parent = nullptr);
+
+        void markDirty(); // Called whenever the history or the stock changes
+        void setVisible(bool isVisible); // Called when the current page of the stacked widget changes
+        void refreshNow(); // Skips the throttle, for when the user asked for it
+
+        quint64 requestedCount() const { return requested; }
+        quint64 coalescedCount() const { return coalesced; }
+        quint64 executedCount() const { return executed; }
+
+    signals:
+        void refreshRequested();
+};
+
+#endif // ANALYTICSSCHEDULER_H
@@ -0,0 +1,114 @@
+#ifndef BENCHHARNESS_H
+#define BENCHHARNESS_H
+
+// Just enough of a benchmark harness for sarisari_bench: runs a body until it has enough samples,
+// keeps min/median/mean/max per benchmark and writes everything out as JSON that can be diffed
+// between releases. The clock is injectable so the harness itself can be driven by a fake one.
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace bench {
+
+using Clock = std::function<qint64()>; // Nanoseconds, only differences matter
+
+inline Clock steadyClock() {
+    return []() {
+        return qint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    };
+}
+
+struct Result {
+    QString name; // e.g. "StockModel::filterItems"
+    qint64 size; // Catalog or history size it ran against
+    int iterations;
+    qint64 minNs;
+    qint64 medianNs;
+    double meanNs;
+    qint64 maxNs;
+    qint64 itemsPerIteration; // For the throughput, 0 if it doesn't make sense
+};
+
+class Harness {
+    private:
+        Clock clock;
+        qint64 minTimeNs; // Keep going until the samples add up to this much...
+        int minIterations; // ...and there are at least this many
+        int maxIterations;
+        QString filter; // Only run benchmarks whose name contains this
+        QVector<Result> results;
+
+    public:
+        explicit Harness(Clock clock = steadyClock(), qint64 minTimeNs = 200000000, int minIterations = 3, int maxIterations = 100000)
+            : clock(std::move(clock)), minTimeNs(minTimeNs), minIterations(minIterations), maxIterations(maxIterations) {}
+
+        void setFilter(const QString &text) { filter = text; }
+        bool wants(const QString &name) const { return filter.isEmpty() || name.contains(filter, Qt::CaseInsensitive); }
+        const QVector<Result> &all() const { return results; }
+
+        // body runs once per iteration and is timed on its own; setup runs before each one, untimed
+        Result *run(const QString &name, qint64 size, qint64 itemsPerIteration, const std::function<void()> &body,
+                    const std::function<void()> &setup = std::function<void()>()) {
+            if (!wants(name))
+                return nullptr;
+
+            QVector<qint64> samples;
+            qint64 total = 0;
+            while (samples.size() < maxIterations && (samples.size() < minIterations || total < minTimeNs)) {
+                if (setup)
+                    setup();
+                const qint64 start = clock();
+                body();
+                const qint64 elapsed = clock() - start;
+                samples.append(elapsed);
+                total += elapsed;
+            }
+
+            std::sort(samples.begin(), samples.end());
+            Result result;
+            result.name = name;
+            result.size = size;
+            result.iterations = samples.size();
+            result.minNs = samples.first();
+            result.medianNs = samples[samples.size() / 2];
+            result.meanNs = double(total) / samples.size();
+            result.maxNs = samples.last();
+            result.itemsPerIteration = itemsPerIteration;
+            results.append(result);
+            return &results.last();
+        }
+
+        QJsonDocument toJson(const QJsonObject &context) const {
+            QJsonArray benchmarks;
+            for (const Result &result : results) {
+                QJsonObject entry;
+                entry["name"] = QString("%1/%2").arg(result.name).arg(result.size); // Stable key to diff on
+                entry["benchmark"] = result.name;
+                entry["size"] = result.size;
+                entry["iterations"] = result.iterations;
+                entry["time_unit"] = "ns";
+                entry["min_time"] = double(result.minNs);
+                entry["median_time"] = double(result.medianNs);
+                entry["mean_time"] = result.meanNs;
+                entry["max_time"] = double(result.maxNs);
+                if (result.itemsPerIteration > 0 && result.meanNs > 0)
+                    entry["items_per_second"] = result.itemsPerIteration * 1e9 / result.meanNs;
+                benchmarks.append(entry);
+            }
+            QJsonObject root;
+            root["context"] = context;
+            root["benchmarks"] = benchmarks;
+            return QJsonDocument(root);
+        }
+};
+
+} // namespace bench
+
+#endif // BENCHHARNESS_H
@@ -0,0 +1,111 @@
+// Compares the shared RecordParser against the istringstream/std::stoi loop the models used to have.
+// Usage: parser_bench [lines]   (defaults to 1,000,000 lines)
+
+#include "../recordparser.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QVector>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct Row { // Same fields as a transaction_history.txt line
+    int transactionId;
+    int itemId;
+    QString productName;
+    double price;
+    int stock;
+    int remaining;
+    int sold;
+    int quantity;
+    QDateTime timestamp;
+};
+
+void generate(const QString &path, int lines) {
+    std::ofstream out(path.toStdString());
+    const char *names[] = {"Lucky Me Pancit Canton", "Coke Mismo", "Skyflakes", "Bear Brand 33g", "Safeguard White"};
+    for (int i = 0; i < lines; i++) {
+        out << (i + 1) << "|" << (i % 500 + 1) << "|" << names[i % 5] << "|" << (10 + i % 90) + 0.25 << "|"
+            << 100 << "|" << 100 - i % 100 << "|" << i % 100 << "|" << (1 + i % 7) << "|"
+            << "2024-0" << (1 + i % 9) << "-1" << (i % 10) << " 1" << (i % 10) << ":3" << (i % 10) << ":0" << (i % 10) << "\n";
+    }
+}
+
+// The loop every readDataFromFile had before RecordParser
+QVector<Row> readLegacy(const QString &path) {
+    QVector<Row> rows;
+    std::ifstream file(path.toStdString());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string token;
+        Row row;
+        std::getline(iss, token, '|'); row.transactionId = std::stoi(token);
+        std::getline(iss, token, '|'); row.itemId = std::stoi(token);
+        std::getline(iss, token, '|'); row.productName = QString::fromStdString(token);
+        std::getline(iss, token, '|'); row.price = std::stod(token);
+        std::getline(iss, token, '|'); row.stock = std::stoi(token);
+        std::getline(iss, token, '|'); row.remaining = std::stoi(token);
+        std::getline(iss, token, '|'); row.sold = std::stoi(token);
+        std::getline(iss, token, '|'); row.quantity = std::stoi(token);
+        std::getline(iss, token, '|'); row.timestamp = QDateTime::fromString(QString::fromStdString(token), "yyyy-MM-dd hh:mm:ss");
+        rows.append(row);
+    }
+    return rows;
+}
+
+QVector<Row> readShared(const QString &path) {
+    QVector<Row> rows;
+    forEachRecord(path, [&rows](RecordParser &fields, std::string_view) {
+        Row row;
+        bool ok = fields.nextInt(row.transactionId) && fields.nextInt(row.itemId)
+            && fields.nextString(row.productName) && fields.nextDouble(row.price)
+            && fields.nextInt(row.stock) && fields.nextInt(row.remaining) && fields.nextInt(row.sold)
+            && fields.nextInt(row.quantity) && fields.nextTimestamp(row.timestamp);
+        if (ok)
+            rows.append(row);
+        return ok;
+    });
+    return rows;
+}
+
+// Sum of a few fields so both readers can be checked against each other
+qint64 checksum(const QVector<Row> &rows) {
+    qint64 sum = 0;
+    for (const Row &row : rows)
+        sum += row.transactionId + row.quantity + qint64(row.price * 100) + row.timestamp.toSecsSinceEpoch() + row.productName.size();
+    return sum;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const int lines = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("transaction_history.txt");
+    generate(path, lines);
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<Row> legacy = readLegacy(path);
+    const qint64 legacyMs = timer.elapsed();
+
+    timer.restart();
+    QVector<Row> shared = readShared(path);
+    const qint64 sharedMs = timer.elapsed();
+
+    const bool same = legacy.size() == shared.size() && checksum(legacy) == checksum(shared);
+    std::printf("lines: %d\n", lines);
+    std::printf("istringstream + stoi: %lld ms\n", static_cast<long long>(legacyMs));
+    std::printf("RecordParser:         %lld ms (%.1fx)\n", static_cast<long long>(sharedMs),
+                sharedMs > 0 ? double(legacyMs) / sharedMs : 0.0);
+    std::printf("results match: %s\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
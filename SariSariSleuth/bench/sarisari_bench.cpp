@@ -0,0 +1,293 @@
+// Times the paths the cashier actually waits on, at catalog/history sizes from 10^2 up to 10^6:
+// loading each data file, filtering the stock, editing an item (and getting it onto the disk),
+// rewriting the stock file the way a journal compaction does, and the analytics tab.
+// Usage: sarisari_bench [--min-size 100] [--max-size 1000000] [--now 2025-06-30T18:00:00]
+//                       [--seed 42] [--filter text] [--min-time-ms 200] [--out results.json]
+// --now pins the clock the analytics count back from, so two runs see the same windows.
+// --data <dir> runs once against a copy of an existing Data directory, e.g. one from sarisari_gen.
+// The JSON goes to --out (stdout if not given), progress goes to stderr.
+
+#include "benchharness.h"
+#include "../stockmodel.h"
+#include "../transactionmodel.h"
+#include "../confirmedtransactionmodel.h"
+#include "../analyticsmodel.h"
+#include "../howmuchmodel.h"
+#include "../binaryhistory.h"
+#include "../namedictionary.h"
+#include "../recordframe.h"
+#include "../iothread.h"
+#include "../durablefile.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+namespace {
+
+const char *WORDS[] = {"Lucky Me", "Pancit Canton", "Coke", "Mismo", "Skyflakes", "Bear Brand", "Safeguard", "Milo",
+                       "Nescafe", "Kopiko", "Tide", "Surf", "Argentina", "Corned Beef", "Century Tuna", "Piattos",
+                       "Nova", "Chippy", "Datu Puti", "Silver Swan", "Magic Sarap", "Knorr", "Royal", "Sprite"};
+const int WORD_COUNT = int(sizeof(WORDS) / sizeof(WORDS[0]));
+
+QString productName(int id) { // Unique, and common words so the filter has something to find
+    return QString("%1 %2 %3").arg(WORDS[id % WORD_COUNT]).arg(WORDS[(id / WORD_COUNT) % WORD_COUNT]).arg(id);
+}
+
+// Same layout StockModel writes, see formatItem in stockmodel.cpp
+void writeStock(int items, std::mt19937 &rng) {
+    std::ofstream out("Data/stock_data.txt", std::ios::binary);
+    std::uniform_int_distribution<int> price(500, 50000);
+    std::uniform_int_distribution<int> stock(0, 200);
+    for (int id = 1; id <= items; id++) {
+        const int total = stock(rng);
+        const int sold = total / 3;
+        std::ostringstream oss;
+        oss << id << "|" << productName(id).toStdString() << "|" << price(rng) / 100.0 << "|"
+            << total << "|" << total - sold << "|" << sold;
+        out << frameRecord(oss.str());
+    }
+}
+
+// Same layout TransactionModel writes
+void writePending(int transactions, int items, const QDateTime &now, std::mt19937 &rng) {
+    std::ofstream out("Data/pending_transactions.txt", std::ios::binary);
+    std::uniform_int_distribution<int> item(1, std::max(items, 1));
+    std::uniform_int_distribution<int> quantity(1, 10);
+    const std::string timestamp = now.toString("yyyy-MM-dd hh:mm:ss").toStdString();
+    for (int id = 1; id <= transactions; id++) {
+        const int itemId = item(rng);
+        std::ostringstream oss;
+        oss << id << "|" << itemId << "|" << productName(itemId).toStdString() << "|" << 12.5 << "|"
+            << quantity(rng) << "|" << timestamp;
+        out << frameRecord(oss.str());
+    }
+}
+
+// A year of sales before now, spread evenly over the given number of products
+QVector<ConfirmedTransaction> makeHistory(qint64 rows, int products, const QDateTime &now, NameDictionary &names, std::mt19937 &rng) {
+    names.clear();
+    for (int id = 1; id <= products; id++) {
+        names.add(productName(id));
+    }
+    std::uniform_int_distribution<int> product(0, products - 1);
+    std::uniform_int_distribution<int> quantity(1, 5);
+    const qint64 end = now.toSecsSinceEpoch();
+    const qint64 span = 365LL * 24 * 3600;
+
+    QVector<ConfirmedTransaction> history;
+    history.reserve(int(rows));
+    for (qint64 i = 0; i < rows; i++) {
+        ConfirmedTransaction transaction;
+        const int nameId = product(rng);
+        transaction.timestamp = end - span + span * i / std::max<qint64>(rows, 1); // Oldest first, like the real file
+        transaction.transactionId = int(i + 1);
+        transaction.itemId = nameId + 1;
+        transaction.nameId = nameId;
+        transaction.quantity = quantity(rng);
+        transaction.priceCents = 1250;
+        history.append(transaction);
+    }
+    return history;
+}
+
+int productsFor(qint64 rows) {
+    return int(std::max<qint64>(10, std::min<qint64>(rows / 20, 10000)));
+}
+
+// Everything for one size, in a Data directory of its own. With dataDir, that directory gets copied
+// in instead of generating one (e.g. from sarisari_gen), and size becomes its history's row count
+qint64 runSize(bench::Harness &harness, qint64 size, const QDateTime &now, quint32 seed, const QString &dataDir) {
+    QTemporaryDir dir;
+    const QString previous = QDir::currentPath();
+    const QDir source(QDir(previous).absoluteFilePath(dataDir));
+    QDir::setCurrent(dir.path()); // The models only know "Data/..."
+    QDir().mkpath("Data");
+    std::mt19937 rng(seed);
+
+    if (dataDir.isEmpty()) {
+        const int n = int(size);
+        writeStock(n, rng);
+        writePending(n, n, now, rng);
+        NameDictionary names;
+        const QVector<ConfirmedTransaction> rows = makeHistory(size, productsFor(size), now, names, rng);
+        BinaryHistory history("Data/transaction_history");
+        history.write(rows, names);
+    } else {
+        for (const QString &file : source.entryList(QDir::Files)) {
+            QFile::copy(source.filePath(file), "Data/" + file);
+        }
+        ConfirmedTransactionModel history;
+        history.readDataFromFile(); // Converts a text history once, so the timed loads below don't
+        size = history.historySize();
+    }
+    std::fprintf(stderr, "size %lld: files ready\n", static_cast<long long>(size));
+
+    {
+        StockModel stock;
+        harness.run("StockModel::readDataFromFile", size, size, [&]() { stock.readDataFromFile(); });
+        const int n = stock.rowCount();
+
+        // One keystroke at a time, the way the filter line edit sends them, then cleared again
+        const QStringList keystrokes = {"p", "pa", "pan", "panc", "panci", "pancit", ""};
+        int keystroke = 0;
+        harness.run("StockModel::filterItems", size, size, [&]() {
+            stock.filterItems(keystrokes[keystroke]);
+            keystroke = (keystroke + 1) % keystrokes.size();
+        });
+        stock.filterItems("");
+
+        // The cashier-visible part of an edit, the journal write itself is queued
+        std::uniform_int_distribution<int> item(1, n);
+        std::uniform_int_distribution<int> price(500, 50000);
+        harness.run("StockModel::updateItemById", size, 1, [&]() {
+            const int id = item(rng);
+            const StockItem *current = stock.findById(id);
+            if (!current)
+                return;
+            StockItem changed = *current;
+            changed.price = price(rng) / 100.0;
+            stock.updateItemById(id, changed);
+        });
+        IoThread::instance().barrier().wait();
+
+        // The same edit until its journal record is written, what used to be updateItemInFile. About one in
+        // a thousand queues a journal compaction, which the barrier waits for too, so the mean includes them
+        harness.run("StockModel::updateItemById/persisted", size, 1, [&]() {
+            const int id = item(rng);
+            const StockItem *current = stock.findById(id);
+            if (!current)
+                return;
+            StockItem changed = *current;
+            changed.price = price(rng) / 100.0;
+            stock.updateItemById(id, changed);
+            IoThread::instance().barrier().wait();
+        });
+
+        // What a journal compaction does on the I/O thread: the whole stock file formatted and replaced
+        // through a synced temporary file
+        harness.run("StockModel::compactJournal", size, size, [&]() {
+            std::string contents = frameRecord("#journal|0");
+            for (int row = 0; row < n; row++) {
+                const StockItem stocked = stock.getItem(row);
+                std::ostringstream oss; // Same layout as formatItem in stockmodel.cpp
+                oss << stocked.id << "|" << stocked.productName.toStdString() << "|" << stocked.price << "|"
+                    << stocked.stock << "|" << stocked.remaining << "|" << stocked.sold;
+                contents += frameRecord(oss.str());
+            }
+            replaceFileDurably("Data/stock_data.txt", QByteArray(contents.data(), int(contents.size())));
+        });
+
+        // Every product in the catalog selling a bit, so every row of the recommendations has a stock item
+        QVector<ProductAnalytics> analytics;
+        analytics.reserve(n);
+        for (int row = 0; row < n; row++) {
+            analytics.append(ProductAnalytics{stock.getItem(row).productName, row % 50, 30, (row % 50) / 30.0});
+        }
+        HowMuchModel howMuch;
+        harness.run("HowMuchModel::updateRecommendations", size, size, [&]() {
+            howMuch.updateRecommendations(analytics, 7, &stock);
+        });
+    }
+
+    {
+        TransactionModel pending;
+        harness.run("TransactionModel::readDataFromFile", size, size, [&]() { pending.readDataFromFile(); });
+    }
+
+    {
+        ConfirmedTransactionModel history;
+        harness.run("ConfirmedTransactionModel::readDataFromFile", size, size, [&]() { history.readDataFromFile(); });
+
+        const SalesRollup rollup = history.salesRollup();
+        harness.run("AnalyticsModel::calculateAnalytics/LastWeek", size, size, [&]() {
+            AnalyticsModel::calculateAnalytics(rollup, TimePeriod::LastWeek, now);
+        });
+        harness.run("AnalyticsModel::calculateAnalytics/LastYear", size, size, [&]() {
+            AnalyticsModel::calculateAnalytics(rollup, TimePeriod::LastYear, now);
+        });
+    }
+
+    IoThread::instance().barrier().wait(); // Nothing may still be writing into dir when it goes
+    QDir::setCurrent(previous);
+    return size;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks for the SariSariSleuth models");
+    parser.addHelpOption();
+    QCommandLineOption minSizeOption("min-size", "Smallest catalog/history size.", "n", "100");
+    QCommandLineOption maxSizeOption("max-size", "Largest catalog/history size.", "n", "1000000");
+    QCommandLineOption nowOption("now", "Reference time for the analytics windows (ISO 8601).", "time", "2025-06-30T18:00:00");
+    QCommandLineOption seedOption("seed", "Seed for the generated data.", "seed", "42");
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains this.", "text");
+    QCommandLineOption minTimeOption("min-time-ms", "Minimum measured time per benchmark.", "ms", "200");
+    QCommandLineOption outOption("out", "Write the JSON here instead of stdout.", "file");
+    QCommandLineOption dataOption("data", "Run once against a copy of this Data directory instead of generated sizes.", "dir");
+    parser.addOptions({minSizeOption, maxSizeOption, nowOption, seedOption, filterOption, minTimeOption, outOption, dataOption});
+    parser.process(app);
+
+    const QDateTime now = QDateTime::fromString(parser.value(nowOption), Qt::ISODate);
+    if (!now.isValid()) {
+        std::fprintf(stderr, "Invalid --now: %s\n", qPrintable(parser.value(nowOption)));
+        return 1;
+    }
+    const qint64 minSize = std::max<qint64>(1, parser.value(minSizeOption).toLongLong());
+    const qint64 maxSize = parser.value(maxSizeOption).toLongLong();
+    const quint32 seed = parser.value(seedOption).toUInt();
+
+    bench::Harness harness(bench::steadyClock(), parser.value(minTimeOption).toLongLong() * 1000000);
+    harness.setFilter(parser.value(filterOption));
+
+    const QString dataDir = parser.value(dataOption);
+    QJsonArray sizes;
+    for (qint64 size = minSize; size <= maxSize; size *= 10) {
+        const qint64 ran = runSize(harness, size, now, seed, dataDir);
+        sizes.append(ran);
+        for (const bench::Result &result : harness.all()) {
+            if (result.size == ran)
+                std::fprintf(stderr, "  %-48s %10.0f ns (%d iterations)\n", qPrintable(result.name), result.meanNs, result.iterations);
+        }
+        if (!dataDir.isEmpty())
+            break; // One directory, one run
+    }
+    IoThread::instance().shutdown();
+
+    QJsonObject context;
+    context["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    context["now"] = now.toString(Qt::ISODate);
+    context["seed"] = qint64(seed);
+    context["sizes"] = sizes;
+    if (!dataDir.isEmpty())
+        context["data"] = dataDir;
+    context["qt_version"] = qVersion();
+#ifdef NDEBUG
+    context["build_type"] = "release";
+#else
+    context["build_type"] = "debug";
+#endif
+
+    const QByteArray json = harness.toJson(context).toJson();
+    if (parser.isSet(outOption)) {
+        QFile out(parser.value(outOption));
+        if (!out.open(QIODevice::WriteOnly) || out.write(json) != json.size()) {
+            std::fprintf(stderr, "Failed to write %s\n", qPrintable(parser.value(outOption)));
+            return 1;
+        }
+    } else {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return 0;
+}
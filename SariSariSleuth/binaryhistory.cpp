@@ -0,0 +1,510 @@
+#include "binaryhistory.h"
+#include "trace.h"
+#include "confirmedtransactionmodel.h"
+#include "iothread.h"
+#include "recordframe.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// Header at the start of every column file
+struct ColumnHeader {
+    char magic[4]; // "SSHC"
+    quint16 version;
+    quint16 elementSize; // Size of one value in bytes
+    quint32 byteOrder; // BYTE_ORDER_MARK as written by the machine that made the file
+    quint32 reserved;
+};
+static_assert(sizeof(ColumnHeader) == 16, "The column header must stay 16 bytes");
+
+const char MAGIC[4] = {'S', 'S', 'H', 'C'};
+const quint32 BYTE_ORDER_MARK = 0x01020304;
+
+template <typename T>
+ColumnHeader makeHeader() {
+    ColumnHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = BinaryHistory::VERSION;
+    header.elementSize = sizeof(T);
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.reserved = 0;
+    return header;
+}
+
+// Number of complete values in a column file, -1 if the file isn't a column of T
+template <typename T>
+qint64 columnRows(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    ColumnHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.version != BinaryHistory::VERSION
+        || header.elementSize != sizeof(T)
+        || header.byteOrder != BYTE_ORDER_MARK) {
+        return -1;
+    }
+    return (file.size() - qint64(sizeof(ColumnHeader))) / qint64(sizeof(T));
+}
+
+// Reads values [first, first + count) of a column file with one seek and one read
+bool readColumn(const QString &path, qint64 elementSize, qint64 first, int count, char *values) {
+    QFile file(path);
+    const qint64 bytes = qint64(count) * elementSize;
+    return file.open(QIODevice::ReadOnly)
+        && file.seek(qint64(sizeof(ColumnHeader)) + first * elementSize)
+        && file.read(values, bytes) == bytes;
+}
+
+// Just the values, the way they sit in the file after the header
+template <typename T>
+QByteArray valueBytes(const QVector<T> &values) {
+    return QByteArray(reinterpret_cast<const char *>(values.constData()), int(values.size() * sizeof(T)));
+}
+
+// The values go out as one write, with the header in front if the column is new
+template <typename T>
+bool appendValues(RecordWriter &writer, const QByteArray &values) {
+    if (writer.size() != 0)
+        return writer.write(values);
+    ColumnHeader header = makeHeader<T>();
+    QByteArray bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+    bytes.append(values);
+    return writer.write(bytes);
+}
+
+// Every column with the size of one value, in the order they are written
+struct ColumnInfo {
+    const char *name;
+    qint64 elementSize;
+};
+const ColumnInfo COLUMNS[] = {
+    {"time", sizeof(qint64)}, {"id", sizeof(qint32)}, {"item", sizeof(qint32)},
+    {"name", sizeof(qint32)}, {"quantity", sizeof(qint32)}, {"price", sizeof(qint64)}
+};
+
+// A whole column file, header and all
+template <typename T>
+QByteArray columnBytes(const QVector<T> &values) {
+    ColumnHeader header = makeHeader<T>();
+    QByteArray bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+    bytes.append(reinterpret_cast<const char *>(values.constData()), int(values.size() * sizeof(T)));
+    return bytes;
+}
+
+// One line of the name dictionary, the line number is the name id
+QByteArray nameRecord(const QString &name) {
+    QByteArray utf8 = name.toUtf8();
+    utf8.replace('\n', ' ');
+    const std::string line = frameRecord(std::string_view(utf8.constData(), size_t(utf8.size())));
+    return QByteArray(line.data(), int(line.size()));
+}
+
+} // namespace
+
+BinaryHistory::BinaryHistory(const QString &basePath) : basePath(basePath) {
+    static_assert(sizeof(COLUMNS) / sizeof(COLUMNS[0]) == COLUMN_COUNT, "One writer per column");
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        columnWriters[i] = std::make_unique<RecordWriter>(columnPath(COLUMNS[i].name));
+    }
+
+    // A row pointing at a name that never made it to disk would lose its name, so names always go out right away
+    DurabilityPolicy namesPolicy = DurabilityPolicy::defaultPolicy();
+    if (namesPolicy.mode == DurabilityPolicy::Batched) {
+        namesPolicy.mode = DurabilityPolicy::FlushEachWrite;
+    }
+    namesWriter = std::make_unique<RecordWriter>(namesPath(), namesPolicy);
+}
+
+void BinaryHistory::settleWriters() {
+    for (const std::unique_ptr<RecordWriter> &writer : columnWriters) {
+        writer->close();
+    }
+    namesWriter->close();
+    IoThread::instance().barrier().wait();
+}
+
+void BinaryHistory::forgetSizes() {
+    for (const std::unique_ptr<RecordWriter> &writer : columnWriters) {
+        writer->forgetSize();
+    }
+    namesWriter->forgetSize();
+}
+
+QString BinaryHistory::columnPath(const char *column) const {
+    return basePath + "." + column + ".col";
+}
+
+QString BinaryHistory::namesPath() const {
+    return basePath + ".names.txt";
+}
+
+bool BinaryHistory::exists() const {
+    return QFile::exists(columnPath("time"));
+}
+
+qint32 BinaryHistory::internName(const QString &name) {
+    const qint32 existing = dictionary.find(name);
+    if (existing >= 0)
+        return existing;
+    if (!internNames({name}))
+        return -1;
+    return dictionary.find(name);
+}
+
+bool BinaryHistory::internNames(const QStringList &names, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("BinaryHistory::internNames");
+
+    // Called by ConfirmedTransactionModel::addTransactions with the names a confirm sells for the first time.
+    // Not waited for: the ids are handed out now, and if the line never makes it to disk dropFailedNames
+    // takes them back before the next name could get the same line number
+
+    dropFailedNames();
+    if (names.isEmpty())
+        return true;
+
+    QByteArray records;
+    for (const QString &name : names) {
+        records.append(nameRecord(name));
+    }
+    if (!namesWriter->write(records))
+        return false;
+
+    lastNames.sizeBefore = dictionary.size();
+    lastNames.written = namesWriter->lastWriteCompletion();
+    for (const QString &name : names) {
+        dictionary.add(name);
+    }
+    if (written)
+        written->push_back(lastNames.written);
+    return true;
+}
+
+void BinaryHistory::dropFailedNames() {
+    if (!lastNames.written.valid() || lastNames.written.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+    if (!lastNames.written.get()) {
+        dictionary.truncate(lastNames.sizeBefore);
+    }
+    lastNames = NamesWrite();
+}
+
+qint64 BinaryHistory::open() {
+    SARI_TRACE_SCOPE("BinaryHistory::open");
+
+    // Called by ConfirmedTransactionModel::readDataFromFile. Only the names get loaded, the rows stay on disk
+
+    settleWriters();
+    forgetSizes(); // A restore may have copied other files in
+    dictionary.clear();
+    lastNames = NamesWrite();
+    queued.clear(); // All on disk now
+
+    // Name dictionary first since the name column refers to it
+    QFile namesFile(namesPath());
+    if (namesFile.exists() && namesFile.open(QIODevice::ReadWrite)) {
+        QByteArray contents = namesFile.readAll();
+        int lastNewline = contents.lastIndexOf('\n');
+        if (lastNewline + 1 < contents.size()) { // Torn last name, no row can refer to it yet
+            namesFile.resize(lastNewline + 1);
+        }
+        int start = 0;
+        while (start <= lastNewline) {
+            int end = contents.indexOf('\n', start);
+            std::string_view line(contents.constData() + start, size_t(end - start));
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            std::string_view payload;
+            QString name;
+            if (unframeRecord(line, payload) == FrameStatus::Corrupt) { // Still takes up its id, so the rows after it keep their names
+                qWarning() << "Name" << dictionary.size() << "in" << namesPath() << "fails its checksum";
+            } else {
+                name = QString::fromUtf8(payload.data(), int(payload.size()));
+            }
+            dictionary.add(name);
+            start = end + 1;
+        }
+        namesFile.close();
+    }
+
+    // Every column must agree on the row count, a crash between column appends can leave some one row longer
+    const qint64 counts[] = {
+        columnRows<qint64>(columnPath("time")),
+        columnRows<qint32>(columnPath("id")),
+        columnRows<qint32>(columnPath("item")),
+        columnRows<qint32>(columnPath("name")),
+        columnRows<qint32>(columnPath("quantity")),
+        columnRows<qint64>(columnPath("price"))
+    };
+    const qint64 rows = *std::min_element(std::begin(counts), std::end(counts));
+    if (rows < 0) {
+        qWarning() << "Binary history" << basePath << "is missing a column or has the wrong version";
+        return -1;
+    }
+    if (*std::max_element(std::begin(counts), std::end(counts)) != rows) {
+        truncate(rows);
+        IoThread::instance().barrier().wait(); // Before anything reads the columns
+    }
+    return rows;
+}
+
+bool BinaryHistory::readRows(qint64 first, int count, QVector<ConfirmedTransaction> &transactions) const {
+    SARI_TRACE_SCOPE("BinaryHistory::readRows");
+
+    // Called for every page the model decodes and by Cursor, so it only reads what it is asked for
+
+    if (count <= 0)
+        return true;
+
+    QVector<qint64> times(count), prices(count);
+    QVector<qint32> ids(count), items(count), nameRefs(count), quantities(count);
+    char *const columns[COLUMN_COUNT] = {
+        reinterpret_cast<char *>(times.data()), reinterpret_cast<char *>(ids.data()), reinterpret_cast<char *>(items.data()),
+        reinterpret_cast<char *>(nameRefs.data()), reinterpret_cast<char *>(quantities.data()), reinterpret_cast<char *>(prices.data())
+    };
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        if (!readValues(i, first, count, columns[i]))
+            return false;
+    }
+
+    transactions.reserve(transactions.size() + count);
+    for (int i = 0; i < count; i++) {
+        ConfirmedTransaction transaction;
+        transaction.timestamp = times[i];
+        transaction.transactionId = ids[i];
+        transaction.itemId = items[i];
+        transaction.nameId = nameRefs[i]; // An id the dictionary doesn't have shows up as an empty name
+        transaction.quantity = quantities[i];
+        transaction.priceCents = prices[i];
+        transactions.append(transaction);
+    }
+    return true;
+}
+
+bool BinaryHistory::readValues(int column, qint64 first, int count, char *values) const {
+    const qint64 size = COLUMNS[column].elementSize;
+    const qint64 queuedFrom = queued.isEmpty() ? first + count : queued.first().first;
+    const int fromFile = int(std::clamp<qint64>(queuedFrom - first, 0, count));
+    if (fromFile > 0 && !readColumn(columnPath(COLUMNS[column].name), size, first, fromFile, values))
+        return false;
+
+    for (const QueuedRows &rows : queued) {
+        const qint64 from = std::max(first + fromFile, rows.first);
+        const qint64 to = std::min(first + count, rows.first + rows.count);
+        if (from < to) {
+            std::memcpy(values + (from - first) * size, rows.values[column].constData() + (from - rows.first) * size, size_t((to - from) * size));
+        }
+    }
+    return true;
+}
+
+void BinaryHistory::dropWritten() {
+
+    // Called before every append and after waiting for one. A failed append was cut back by whoever waited on it
+
+    while (!queued.isEmpty()) {
+        for (const std::shared_future<bool> &written : queued.first().written) {
+            if (written.valid() && written.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+        }
+        queued.removeFirst();
+    }
+}
+
+qint64 BinaryHistory::rowCount() const {
+    const qint64 size = columnWriters[0]->size(); // Counts what is still buffered too
+    if (size < qint64(sizeof(ColumnHeader)))
+        return -1;
+    return (size - qint64(sizeof(ColumnHeader))) / COLUMNS[0].elementSize;
+}
+
+bool BinaryHistory::append(const QVector<ConfirmedTransaction> &transactions, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("BinaryHistory::append");
+
+    // Called by ConfirmedTransactionModel::addTransactions, a single confirm is just a batch of one
+
+    if (transactions.isEmpty())
+        return true;
+
+    dropWritten();
+    const qint64 rowsBefore = std::max<qint64>(rowCount(), 0);
+
+    QVector<qint64> times, prices;
+    QVector<qint32> ids, items, nameRefs, quantities;
+    times.reserve(transactions.size());
+    prices.reserve(transactions.size());
+    ids.reserve(transactions.size());
+    items.reserve(transactions.size());
+    nameRefs.reserve(transactions.size());
+    quantities.reserve(transactions.size());
+
+    for (const ConfirmedTransaction &transaction : transactions) {
+        times.append(transaction.timestamp);
+        ids.append(transaction.transactionId);
+        items.append(transaction.itemId);
+        nameRefs.append(transaction.nameId);
+        quantities.append(transaction.quantity);
+        prices.append(transaction.priceCents);
+    }
+
+    QueuedRows appended;
+    appended.first = rowsBefore;
+    appended.count = transactions.size();
+    appended.values[0] = valueBytes(times);
+    appended.values[1] = valueBytes(ids);
+    appended.values[2] = valueBytes(items);
+    appended.values[3] = valueBytes(nameRefs);
+    appended.values[4] = valueBytes(quantities);
+    appended.values[5] = valueBytes(prices);
+
+    const bool ok = appendValues<qint64>(*columnWriters[0], appended.values[0])
+        && appendValues<qint32>(*columnWriters[1], appended.values[1])
+        && appendValues<qint32>(*columnWriters[2], appended.values[2])
+        && appendValues<qint32>(*columnWriters[3], appended.values[3])
+        && appendValues<qint32>(*columnWriters[4], appended.values[4])
+        && appendValues<qint64>(*columnWriters[5], appended.values[5]);
+    if (!ok) {
+        truncate(rowsBefore); // Whatever made it into some of the columns goes again
+        return false;
+    }
+
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        appended.written[i] = columnWriters[i]->lastWriteCompletion();
+        if (written)
+            written->push_back(appended.written[i]);
+    }
+    queued.append(appended);
+    return true;
+}
+
+bool BinaryHistory::truncate(qint64 rows, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("BinaryHistory::truncate");
+
+    // Called by read to even out the columns after a crash, by append when a column write failed,
+    // and by ConfirmedTransactionModel::removeLastTransactions
+
+    if (rows <= 0) { // Nothing to keep, and a half created set of columns wouldn't read back
+        remove();
+        return true;
+    }
+
+    dropFailedNames(); // The rows that used them are about to go too
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        // Queued, does nothing if it's already shorter
+        const std::shared_future<bool> truncated = columnWriters[i]->truncate(qint64(sizeof(ColumnHeader)) + rows * COLUMNS[i].elementSize);
+        if (written)
+            written->push_back(truncated);
+    }
+    while (!queued.isEmpty() && queued.last().first >= rows) {
+        queued.removeLast();
+    }
+    if (!queued.isEmpty() && queued.last().first + queued.last().count > rows) {
+        QueuedRows &last = queued.last();
+        last.count = rows - last.first;
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            last.values[i].truncate(int(last.count * COLUMNS[i].elementSize));
+        }
+    }
+    return true;
+}
+
+bool BinaryHistory::write(const QVector<ConfirmedTransaction> &transactions, const NameDictionary &names) {
+    SARI_TRACE_SCOPE("BinaryHistory::write");
+
+    // Called when converting the text history, rebuilds everything from scratch
+
+    QDir().mkpath(QFileInfo(basePath).path());
+
+    QVector<qint64> times, prices;
+    QVector<qint32> ids, items, nameRefs, quantities;
+    times.reserve(transactions.size());
+    prices.reserve(transactions.size());
+    ids.reserve(transactions.size());
+    items.reserve(transactions.size());
+    nameRefs.reserve(transactions.size());
+    quantities.reserve(transactions.size());
+
+    QByteArray namesData;
+    for (qint32 id = 0; id < names.size(); id++) {
+        namesData.append(nameRecord(names.name(id)));
+    }
+    dictionary = names;
+    lastNames = NamesWrite();
+    queued.clear(); // Replaced along with the files
+
+    for (const ConfirmedTransaction &transaction : transactions) {
+        times.append(transaction.timestamp);
+        ids.append(transaction.transactionId);
+        items.append(transaction.itemId);
+        nameRefs.append(transaction.nameId);
+        quantities.append(transaction.quantity);
+        prices.append(transaction.priceCents);
+    }
+
+    // Each file is replaced atomically on the I/O thread, in order with anything still queued for it
+    const IoThread::Completion written[] = {
+        IoThread::instance().replace(namesPath(), namesData),
+        IoThread::instance().replace(columnPath("time"), columnBytes(times)),
+        IoThread::instance().replace(columnPath("id"), columnBytes(ids)),
+        IoThread::instance().replace(columnPath("item"), columnBytes(items)),
+        IoThread::instance().replace(columnPath("name"), columnBytes(nameRefs)),
+        IoThread::instance().replace(columnPath("quantity"), columnBytes(quantities)),
+        IoThread::instance().replace(columnPath("price"), columnBytes(prices))
+    };
+    bool ok = true;
+    for (const IoThread::Completion &completion : written) {
+        ok = completion.get() && ok;
+    }
+    forgetSizes();
+    return ok;
+}
+
+void BinaryHistory::remove() {
+    SARI_TRACE_SCOPE("BinaryHistory::remove");
+
+    // Waits, so a restore can copy new files in right after
+
+    for (const ColumnInfo &column : COLUMNS) {
+        IoThread::instance().remove(columnPath(column.name));
+    }
+    IoThread::instance().remove(namesPath());
+    IoThread::instance().barrier().wait();
+    forgetSizes();
+    dictionary.clear();
+    lastNames = NamesWrite();
+    queued.clear();
+}
+
+// CURSOR
+BinaryHistory::Cursor::Cursor(const BinaryHistory &history, qint64 rows)
+    : history(history)
+    , position(0)
+    , end(std::max<qint64>(rows, 0))
+    , index(0)
+{
+}
+
+bool BinaryHistory::Cursor::next(ConfirmedTransaction &transaction) {
+    if (index == chunk.size()) {
+        if (position >= end)
+            return false;
+        const int count = int(std::min<qint64>(CHUNK_ROWS, end - position));
+        chunk.clear(); // Keeps its capacity, so the same buffer is reused for every chunk
+        if (!history.readRows(position, count, chunk)) {
+            qWarning() << "Failed to read history rows" << position << "to" << position + count;
+            return false;
+        }
+        position += count;
+        index = 0;
+    }
+    transaction = chunk[index++];
+    return true;
+}
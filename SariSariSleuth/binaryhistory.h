@@ -0,0 +1,92 @@
+#ifndef BINARYHISTORY_H
+#define BINARYHISTORY_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <future>
+#include <memory>
+#include "namedictionary.h"
+#include "recordwriter.h"
+
+struct ConfirmedTransaction;
+
+// Binary, column-per-file version of transaction_history.txt
+// Every column lives in its own "<base>.<column>.col" file (a 16 byte header followed by
+// fixed size values) so reading rows back is one seek and one read per column instead of a text parse.
+// Rows the I/O thread hasn't written yet are read from the copy append keeps, never waited for.
+// Product names are stored once in "<base>.names.txt" and referenced by their line number,
+// which is also their id in names().
+class BinaryHistory {
+    private:
+        QString basePath; // e.g. "Data/transaction_history"
+        NameDictionary dictionary; // Mirrors the names file
+
+        // Append through the I/O thread, one per column in the order of COLUMNS in binaryhistory.cpp
+        static const int COLUMN_COUNT = 6;
+        std::unique_ptr<RecordWriter> columnWriters[COLUMN_COUNT];
+        std::unique_ptr<RecordWriter> namesWriter;
+        void settleWriters(); // Waits until everything they queued is on disk, before the files get read
+
+        // The last names write, the dictionary gives its names ids before the I/O thread gets to it
+        struct NamesWrite {
+            int sizeBefore = 0; // Dictionary size before it
+            std::shared_future<bool> written;
+        };
+        NamesWrite lastNames;
+        void dropFailedNames(); // Takes the names of a write that didn't make it out of the dictionary again
+
+        // The column bytes of appends the I/O thread may not have written yet, so readRows never waits on it
+        struct QueuedRows {
+            qint64 first = 0; // Row number of the first row
+            qint64 count = 0;
+            QByteArray values[COLUMN_COUNT]; // Without the column header
+            std::shared_future<bool> written[COLUMN_COUNT];
+        };
+        QVector<QueuedRows> queued; // Oldest first, and always the last rows of the history
+        void dropWritten(); // Forgets the ones every column has finished with, oldest first
+        bool readValues(int column, qint64 first, int count, char *values) const; // From the file, the rest from queued
+        void forgetSizes(); // After the files were replaced or removed
+
+        QString columnPath(const char *column) const;
+        QString namesPath() const;
+
+    public:
+        static const quint16 VERSION = 1;
+
+        explicit BinaryHistory(const QString &basePath);
+
+        bool exists() const;
+        const NameDictionary &names() const { return dictionary; }
+        qint32 internName(const QString &name); // Adds the name to the names file if it is new, -1 if that failed
+        bool internNames(const QStringList &names, WriteCompletions *written = nullptr); // New names only, one write for all of them
+        qint64 open(); // Loads the names and trims columns left uneven by a torn append. Row count, -1 if unreadable
+        qint64 rowCount() const; // -1 if there is no history yet
+        bool readRows(qint64 first, int count, QVector<ConfirmedTransaction> &transactions) const; // Appends rows [first, first + count)
+        // All or nothing, one write per column. Names must be interned already. Adds the column writes to written
+        bool append(const QVector<ConfirmedTransaction> &transactions, WriteCompletions *written = nullptr);
+        // Drops every row from rows on, used to undo an append. Queued, except for rows <= 0
+        bool truncate(qint64 rows, WriteCompletions *written = nullptr);
+        bool write(const QVector<ConfirmedTransaction> &transactions, const NameDictionary &names); // Replaces whatever is on disk, names() becomes names
+        void remove();
+
+        // Goes through the history front to back a chunk at a time, for the rollup and the export.
+        // Only ever holds one chunk, however many years of history there are
+        class Cursor {
+            private:
+                const BinaryHistory &history;
+                qint64 position; // First row of the next chunk
+                qint64 end;
+                QVector<ConfirmedTransaction> chunk;
+                int index; // Next row in chunk
+
+            public:
+                static const int CHUNK_ROWS = 4096;
+
+                Cursor(const BinaryHistory &history, qint64 rows);
+                bool next(ConfirmedTransaction &transaction); // false at the end, or when a chunk can't be read
+        };
+};
+
+#endif // BINARYHISTORY_H
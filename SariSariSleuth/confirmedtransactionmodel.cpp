@@ -1,21 +1,34 @@
 #include "confirmedtransactionmodel.h"
+#include "trace.h"
+#include "metrics.h"
+#include "recordparser.h"
 #include <QDebug>
 #include <QDir>
-#include <fstream>
+#include <QFile>
+#include <QSaveFile>
 #include <sstream>
+#include <algorithm>
+
+static qint64 toCentavos(double price) {
+    return qRound64(price * 100.0);
+}
 
 // CONSTRUCTOR
 ConfirmedTransactionModel::ConfirmedTransactionModel(QObject *parent)
     : QAbstractTableModel(parent)
-    , nextTransactionId(1) {
-    readDataFromFile();
+    , totalRows(0)
+    , loadedRows(0)
+    , pages(CACHED_PAGES)
+    , nextTransactionId(1)
+    , history("Data/transaction_history") {
+    // Starts out empty, MainWindow loads the history on a worker thread (see loadFromDisk)
 }
 
 // NECESSARY OVERRIDES, see stockmodel.cpp and stockmodel.h for more complete documentation
 int ConfirmedTransactionModel::rowCount(const QModelIndex &parent) const {
     if (parent.isValid())
         return 0;
-    return transactions.size();
+    return loadedRows;
 }
 
 int ConfirmedTransactionModel::columnCount(const QModelIndex &parent) const {
@@ -25,17 +38,20 @@ int ConfirmedTransactionModel::columnCount(const QModelIndex &parent) const {
 }
 
 QVariant ConfirmedTransactionModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= transactions.size() || index.column() >= 5)
+    if (!index.isValid() || index.row() >= loadedRows || index.column() >= 5)
         return QVariant();
 
     if (role == Qt::DisplayRole || role == Qt::EditRole) {
-        const ConfirmedTransaction &transaction = transactions[index.row()];
+        const ConfirmedTransaction *decoded = row(index.row());
+        if (!decoded)
+            return QVariant();
+        const ConfirmedTransaction transaction = *decoded; // The page may get evicted by the next lookup
         switch (index.column()) {
             case 0: return transaction.transactionId;
-            case 1: return transaction.item.productName;
-            case 2: return QString::number(transaction.item.price, 'f', 2);
+            case 1: return productName(transaction); // Through the dictionary, the row only has an id
+            case 2: return QString::number(transaction.price(), 'f', 2);
             case 3: return transaction.quantity;
-            case 4: return transaction.timestamp.toString("yyyy-MM-dd hh:mm:ss");
+            case 4: return transaction.dateTime().toString("yyyy-MM-dd hh:mm:ss");
             default: return QVariant();
         }
     }
@@ -59,105 +75,288 @@ QVariant ConfirmedTransactionModel::headerData(int section, Qt::Orientation orie
     return QVariant();
 }
 
-// ACTUAL IMPLEMENTED FUNCTIONS
-void ConfirmedTransactionModel::addTransaction(const StockItem &item, int quantity) {
-    beginInsertRows(QModelIndex(), transactions.size(), transactions.size());
-    
-    ConfirmedTransaction transaction;
-    transaction.transactionId = nextTransactionId++;
-    transaction.item = item;
-    transaction.quantity = quantity;
-    transaction.timestamp = QDateTime::currentDateTime();
-    
-    transactions.append(transaction);
-    writeTransactionToFile(transaction);
+bool ConfirmedTransactionModel::canFetchMore(const QModelIndex &parent) const {
+    return !parent.isValid() && loadedRows < totalRows;
+}
+
+void ConfirmedTransactionModel::fetchMore(const QModelIndex &parent) {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::fetchMore");
+
+    // Called by the views once they scroll to the end of what they have
+
+    if (parent.isValid())
+        return;
+    const int more = int(std::min<qint64>(PAGE_ROWS, totalRows - loadedRows));
+    if (more <= 0)
+        return;
+    beginInsertRows(QModelIndex(), loadedRows, loadedRows + more - 1);
+    loadedRows += more;
     endInsertRows();
 }
 
+// ACTUAL IMPLEMENTED FUNCTIONS
+const ConfirmedTransaction *ConfirmedTransactionModel::row(qint64 row) const {
+    if (row < 0 || row >= totalRows)
+        return nullptr;
+
+    const qint64 pageNumber = row / PAGE_ROWS;
+    const qint64 first = pageNumber * PAGE_ROWS;
+    QVector<ConfirmedTransaction> *page = pages.object(pageNumber);
+    if (!page) {
+        page = new QVector<ConfirmedTransaction>();
+        if (!history.readRows(first, int(std::min<qint64>(PAGE_ROWS, totalRows - first)), *page)) {
+            qWarning() << "Failed to read page" << pageNumber << "of the history";
+            delete page;
+            return nullptr;
+        }
+        pages.insert(pageNumber, page); // The cache owns it now
+    }
+    return row - first < page->size() ? &page->at(int(row - first)) : nullptr;
+}
+
+void ConfirmedTransactionModel::forgetPages(qint64 fromRow) {
+    const qint64 lastPage = totalRows / PAGE_ROWS;
+    for (qint64 pageNumber = std::max<qint64>(fromRow, 0) / PAGE_ROWS; pageNumber <= lastPage; pageNumber++) {
+        pages.remove(pageNumber);
+    }
+}
+
+bool ConfirmedTransactionModel::addTransaction(const StockItem &item, int quantity) {
+    Transaction sale;
+    sale.transactionId = 0;
+    sale.itemId = item.id;
+    sale.productName = item.productName;
+    sale.price = item.price;
+    sale.quantity = quantity;
+    return addTransactions({sale});
+}
+
+bool ConfirmedTransactionModel::addTransactions(const QVector<Transaction> &sales, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::addTransactions");
+
+    // Called by InventoryService::confirmPending with every sale in the selection
+
+    if (sales.isEmpty())
+        return true;
+
+    // Names nobody sold before go into the names file in one write, a new name nobody refers to yet is harmless
+    QStringList newNames;
+    for (const Transaction &sale : sales) {
+        if (history.names().find(sale.productName) < 0 && !newNames.contains(sale.productName)) {
+            newNames.append(sale.productName);
+        }
+    }
+    if (!history.internNames(newNames, written)) {
+        qWarning() << "Failed to add" << newNames.size() << "names to the history";
+        return false;
+    }
+
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    QVector<ConfirmedTransaction> confirmed;
+    confirmed.reserve(sales.size());
+    for (int i = 0; i < sales.size(); i++) {
+        ConfirmedTransaction transaction;
+        transaction.timestamp = now;
+        transaction.transactionId = nextTransactionId + i;
+        transaction.itemId = sales[i].itemId;
+        transaction.nameId = history.names().find(sales[i].productName);
+        transaction.quantity = sales[i].quantity;
+        transaction.priceCents = toCentavos(sales[i].price);
+        confirmed.append(transaction);
+    }
+
+    // Queued, not waited for: the rows read back from the copy the history keeps until the I/O thread has them.
+    // Whoever needs to know they made it waits on written, and takes them back out with removeLastTransactions
+    if (!history.append(confirmed, written)) {
+        qWarning() << "Failed to append" << confirmed.size() << "transactions to the history";
+        return false;
+    }
+
+    const QDate today = QDateTime::fromSecsSinceEpoch(now).date();
+    for (const ConfirmedTransaction &transaction : confirmed) {
+        rollup.add(productName(transaction), today, transaction.quantity); // Keeps the analytics current without a rescan
+    }
+    nextTransactionId += confirmed.size();
+
+    const qint64 first = totalRows;
+    forgetPages(first); // The last page grew
+    totalRows += confirmed.size();
+    if (loadedRows == first) { // The views already have everything, so they get the new rows right away
+        beginInsertRows(QModelIndex(), loadedRows, loadedRows + confirmed.size() - 1);
+        loadedRows += confirmed.size();
+        endInsertRows();
+    }
+    emit historyChanged();
+    return true;
+}
+
+bool ConfirmedTransactionModel::removeLastTransactions(int count, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::removeLastTransactions");
+
+    // Called by InventoryService to roll a confirm back
+
+    count = int(std::min<qint64>(count, totalRows));
+    if (count <= 0)
+        return true;
+
+    const qint64 first = totalRows - count;
+    QVector<ConfirmedTransaction> removed; // Read back for the rollup, they were only just appended
+    if (history.readRows(first, count, removed)) {
+        for (const ConfirmedTransaction &transaction : removed) {
+            rollup.subtract(productName(transaction), transaction.dateTime().date(), transaction.quantity);
+        }
+    }
+    const bool truncated = history.truncate(first, written);
+    if (!truncated) {
+        qWarning() << "Failed to take" << count << "transactions back out of the history";
+    }
+
+    forgetPages(first);
+    totalRows = first;
+    if (loadedRows > first) {
+        beginRemoveRows(QModelIndex(), int(first), loadedRows - 1);
+        loadedRows = int(first);
+        endRemoveRows();
+    }
+    nextTransactionId -= count;
+    emit historyChanged();
+    return truncated;
+}
+
 ConfirmedTransaction ConfirmedTransactionModel::getTransaction(int row) const {
-    if (row >= 0 && row < transactions.size())
-        return transactions[row];
-    return ConfirmedTransaction();
+    const ConfirmedTransaction *transaction = this->row(row);
+    return transaction ? *transaction : ConfirmedTransaction();
 }
 
 void ConfirmedTransactionModel::clearTransactions() {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::clearTransactions");
     beginResetModel();
-    transactions.clear();
+    pages.clear();
+    totalRows = 0;
+    loadedRows = 0;
+    rollup.clear();
     nextTransactionId = 1;
-    // Delete the file
+    // Delete the files
+    history.remove();
     std::remove(DATA_FILE.toStdString().c_str());
     endResetModel();
+    emit historyChanged();
 }
 
-void ConfirmedTransactionModel::writeTransactionToFile(const ConfirmedTransaction &transaction) {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ofstream file(DATA_FILE.toStdString(), std::ios::app);
-    if (file.is_open()) {
-        file << transaction.transactionId << "|"
-             << transaction.item.id << "|"
-             << transaction.item.productName.toStdString() << "|"
-             << transaction.item.price << "|"
-             << transaction.item.stock << "|"
-             << transaction.item.remaining << "|"
-             << transaction.item.sold << "|"
-             << transaction.quantity << "|"
-             << transaction.timestamp.toString("yyyy-MM-dd hh:mm:ss").toStdString() << std::endl;
-        file.close();
-    }
+// Formats a transaction the same way it is laid out in transaction_history.txt. Stock levels at
+// the time of the sale aren't kept anymore, so those three fields are always 0
+static std::string formatTransaction(const ConfirmedTransaction &transaction, const QString &productName) {
+    std::ostringstream oss;
+    oss << transaction.transactionId << "|"
+        << transaction.itemId << "|"
+        << productName.toStdString() << "|"
+        << transaction.price() << "|"
+        << 0 << "|"
+        << 0 << "|"
+        << 0 << "|"
+        << transaction.quantity << "|"
+        << transaction.dateTime().toString("yyyy-MM-dd hh:mm:ss").toStdString();
+    return oss.str();
 }
 
 void ConfirmedTransactionModel::readDataFromFile() {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ifstream file(DATA_FILE.toStdString());
-    if (!file.is_open()) {
-        return; // File doesn't exist yet, that's okay
-    }
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::readDataFromFile");
 
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string token;
-        ConfirmedTransaction transaction;
+    // Called by the restore, startup goes through loadFromDisk on a worker and applyLoaded instead
 
-        // Read Transaction ID
-        std::getline(iss, token, '|');
-        transaction.transactionId = std::stoi(token);
-        nextTransactionId = std::max(nextTransactionId, transaction.transactionId + 1);
+    applyLoaded(loadFromDisk());
+}
 
-        // Read StockItem data
-        std::getline(iss, token, '|');
-        transaction.item.id = std::stoi(token);
+ConfirmedTransactionModel::LoadResult ConfirmedTransactionModel::loadFromDisk() {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::loadFromDisk");
+    Metrics::ScopedTimer timer(Metrics::loadHistory);
+    // Create Data directory if it doesn't exist
+    QDir().mkpath("Data");
 
-        std::getline(iss, token, '|');
-        transaction.item.productName = QString::fromStdString(token);
+    if (!history.exists() && QFile::exists(DATA_FILE)) {
+        // History from before the binary format: convert it once, the text file is left untouched
+        QVector<ConfirmedTransaction> converted;
+        NameDictionary names;
+        readTextFile(DATA_FILE, converted, names);
+        if (!history.write(converted, names)) {
+            qWarning() << "Failed to convert" << DATA_FILE << "to the binary history format";
+        }
+    }
 
-        std::getline(iss, token, '|');
-        transaction.item.price = std::stod(token);
+    LoadResult result;
+    result.rows = history.exists() ? std::max<qint64>(history.open(), 0) : 0;
 
-        std::getline(iss, token, '|');
-        transaction.item.stock = std::stoi(token);
+    // Streams through the history, so it never holds more than a chunk of it
+    BinaryHistory::Cursor cursor(history, result.rows);
+    ConfirmedTransaction transaction;
+    while (cursor.next(transaction)) {
+        result.rollup.add(productName(transaction), transaction.dateTime().date(), transaction.quantity);
+        result.nextTransactionId = std::max(result.nextTransactionId, transaction.transactionId + 1);
+    }
+    return result;
+}
 
-        std::getline(iss, token, '|');
-        transaction.item.remaining = std::stoi(token);
+void ConfirmedTransactionModel::applyLoaded(const LoadResult &loaded) {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::applyLoaded");
+    beginResetModel();
+    pages.clear();
+    totalRows = loaded.rows;
+    loadedRows = int(std::min<qint64>(totalRows, PAGE_ROWS)); // The views fetch the rest as they scroll
+    rollup = loaded.rollup; // addTransactions keeps it up to date from here on
+    nextTransactionId = loaded.nextTransactionId;
+    endResetModel();
+    emit historyChanged();
+}
 
-        std::getline(iss, token, '|');
-        transaction.item.sold = std::stoi(token);
+bool ConfirmedTransactionModel::importTextHistory(const QString &path) {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::importTextHistory");
+    QVector<ConfirmedTransaction> imported;
+    NameDictionary names;
+    if (!readTextFile(path, imported, names) || !history.write(imported, names))
+        return false;
+    imported.clear();
 
-        // Read Quantity
-        std::getline(iss, token, '|');
-        transaction.quantity = std::stoi(token);
+    applyLoaded(loadFromDisk());
+    return true;
+}
 
-        // Read Timestamp
-        std::getline(iss, token, '|');
-        transaction.timestamp = QDateTime::fromString(QString::fromStdString(token), "yyyy-MM-dd hh:mm:ss");
+bool ConfirmedTransactionModel::exportTextHistory(const QString &path) const {
+    SARI_TRACE_SCOPE("ConfirmedTransactionModel::exportTextHistory");
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
 
-        // Add to transactions list
-        transactions.append(transaction);
+    BinaryHistory::Cursor cursor(history, totalRows);
+    ConfirmedTransaction transaction;
+    while (cursor.next(transaction)) {
+        std::string line = formatTransaction(transaction, productName(transaction)) + "\n";
+        file.write(line.data(), line.size());
     }
+    return file.commit();
+}
+
+bool ConfirmedTransactionModel::readTextFile(const QString &path, QVector<ConfirmedTransaction> &out, NameDictionary &names) const {
+    int malformed = forEachRecord(path, [&out, &names](RecordParser &fields, std::string_view) {
+        ConfirmedTransaction transaction;
+        QString productName;
+        double price;
+        std::string_view stockLevels; // Stock, remaining and sold at the time, not kept
+        QDateTime timestamp;
+        bool ok = fields.nextInt(transaction.transactionId) // Read Transaction ID
+            && fields.nextInt(transaction.itemId) // Read item data
+            && fields.nextString(productName)
+            && fields.nextDouble(price)
+            && fields.next(stockLevels) && fields.next(stockLevels) && fields.next(stockLevels)
+            && fields.nextInt(transaction.quantity) // Read Quantity
+            && fields.nextTimestamp(timestamp); // Read Timestamp
+        if (!ok)
+            return false;
 
-    file.close();
-} 
+        transaction.nameId = names.intern(productName);
+        transaction.priceCents = toCentavos(price);
+        transaction.timestamp = timestamp.toSecsSinceEpoch();
+        out.append(transaction);
+        return true;
+    });
+    return malformed >= 0;
+}
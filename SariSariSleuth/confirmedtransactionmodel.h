@@ -2,37 +2,70 @@
 #define CONFIRMEDTRANSACTIONMODEL_H
 
 #include <QAbstractTableModel>
+#include <QCache>
 #include <QVector>
 #include <QDateTime>
-#include "stockmodel.h"
+#include "transactionmodel.h"
+#include "binaryhistory.h"
+#include "salesrollup.h"
 
+// One row of the history, 32 bytes and nothing on the heap. The product name is an id into the
+// history's NameDictionary, and the price is the unit price at the time of the sale
 struct ConfirmedTransaction {
-    int transactionId;
-    StockItem item;
-    int quantity;
-    QDateTime timestamp;
+    qint64 timestamp; // Seconds since the epoch
+    qint32 transactionId;
+    qint32 itemId;
+    qint32 nameId;
+    qint32 quantity;
+    qint64 priceCents; // Centavos, so prices survive the round trip exactly
+
+    double price() const { return priceCents / 100.0; }
+    QDateTime dateTime() const { return QDateTime::fromSecsSinceEpoch(timestamp); }
 
     bool operator==(const ConfirmedTransaction &other) const {
         return transactionId == other.transactionId &&
-               item == other.item &&
+               itemId == other.itemId &&
+               nameId == other.nameId &&
                quantity == other.quantity &&
+               priceCents == other.priceCents &&
                timestamp == other.timestamp;
     }
 };
+static_assert(sizeof(ConfirmedTransaction) == 32, "History rows are meant to stay this small");
+Q_DECLARE_TYPEINFO(ConfirmedTransaction, Q_PRIMITIVE_TYPE);
 
 class ConfirmedTransactionModel : public QAbstractTableModel {
     Q_OBJECT
 
     private:
-        QVector<ConfirmedTransaction> transactions;
+        // Rows stay on disk and get decoded a page at a time when something asks for them
+        static const int PAGE_ROWS = 256;
+        static const int CACHED_PAGES = 64; // Decoded pages kept around, the least recently used one goes first
+        qint64 totalRows; // Rows in the history
+        int loadedRows; // Rows the views have been told about, fetchMore adds a page at a time
+        mutable QCache<qint64, QVector<ConfirmedTransaction>> pages; // Page number -> its rows
         int nextTransactionId;
-        const QString DATA_FILE = "Data/transaction_history.txt";
+        const QString DATA_FILE = "Data/transaction_history.txt"; // Text format, only used for import/export now
+        BinaryHistory history; // The actual storage, see binaryhistory.h
+        SalesRollup rollup; // Daily sales per product, what the analytics read
+
+        const ConfirmedTransaction *row(qint64 row) const; // Decodes the row's page if it isn't cached, nullptr if it can't be read
+        void forgetPages(qint64 fromRow); // Drops cached pages from the one holding fromRow on
 
         // Helper functions for file operations
-        void writeTransactionToFile(const ConfirmedTransaction &transaction);
+        bool readTextFile(const QString &path, QVector<ConfirmedTransaction> &out, NameDictionary &names) const;
 
     public:
-        void readDataFromFile();
+        void readDataFromFile(); // Reads the history again right here, e.g. after a restore
+
+        // Loading split in two, so the slow part can run on a worker while the model sits empty
+        struct LoadResult {
+            qint64 rows = 0;
+            SalesRollup rollup;
+            int nextTransactionId = 1;
+        };
+        LoadResult loadFromDisk(); // Opens the history and streams through it for the rollup. Off the GUI thread is fine, as long as nothing else uses the model meanwhile
+        void applyLoaded(const LoadResult &loaded); // GUI thread, replaces whatever the model had
         explicit ConfirmedTransactionModel(QObject *parent = nullptr);
 
     // Required overrides for QAbstractTableModel
@@ -40,11 +73,28 @@ class ConfirmedTransactionModel : public QAbstractTableModel {
         int columnCount(const QModelIndex &parent = QModelIndex()) const override;
         QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
         QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+        bool canFetchMore(const QModelIndex &parent) const override;
+        void fetchMore(const QModelIndex &parent) override;
 
     // Custom methods for data manipulation
-        void addTransaction(const StockItem &item, int quantity);
+        bool addTransaction(const StockItem &item, int quantity);
+        // Pending transactions with the quantity actually sold. All or nothing, queued in one write per history file,
+        // the model shows them right away. Adds those writes to written
+        bool addTransactions(const QVector<Transaction> &sales, WriteCompletions *written = nullptr);
+        // Undoes addTransactions when the rest of a confirm failed, false if the history couldn't be cut back. Same for written
+        bool removeLastTransactions(int count, WriteCompletions *written = nullptr);
         ConfirmedTransaction getTransaction(int row) const;
+        qint64 historySize() const { return totalRows; } // rowCount only counts what was fetched
+        const QString &productName(const ConfirmedTransaction &transaction) const { return history.names().name(transaction.nameId); }
+        const SalesRollup &salesRollup() const { return rollup; }
         void clearTransactions();
+
+    // Text format import/export
+        bool importTextHistory(const QString &path); // Replaces the history with the text file and converts it to binary
+        bool exportTextHistory(const QString &path) const;
+
+    signals:
+        void historyChanged(); // Rows were confirmed, rolled back or reloaded. Fetching more rows doesn't count
 };
 
 #endif
@@ -0,0 +1,182 @@
+#include "datarecovery.h"
+#include "trace.h"
+#include "durablefile.h"
+#include "recordframe.h"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Where one text record file stands
+struct ScanResult {
+    qint64 keepSize = 0; // Everything past this is a torn tail
+    bool missingNewline = false; // The last record is whole, only its newline never made it
+    int corruptRecords = 0; // Bad records before keepSize, the readers skip them
+    int tornRecords = 0; // Lines past keepSize
+};
+
+// How many fields a whole unframed line can have in each file that was written before the framing, a torn one
+// is nearly always short. Empty for the files that have always been framed
+QVector<int> legacyFieldCounts(const QString &name) {
+    if (name == "stock_data.txt")
+        return {6, 2}; // Items, and the "#journal|seq" header
+    if (name == "stock_journal.txt" || name == "stock_journal.old.txt")
+        return {8, 3}; // "seq|U|item" and "seq|D|id"
+    if (name == "pending_transactions.txt")
+        return {6, 9, 1}; // Both layouts, and "-id" tombstones
+    if (name == "transaction_history.txt")
+        return {9};
+    if (name.endsWith(".names.txt"))
+        return {1};
+    return {};
+}
+
+ScanResult scanRecords(const char *data, qint64 size, const QVector<int> &legacyFields) {
+    ScanResult result;
+    int badSinceLastGood = 0;
+    qint64 position = 0;
+    while (position < size) {
+        const char *start = data + position;
+        const char *newline = static_cast<const char *>(std::memchr(start, '\n', size_t(size - position)));
+        const qint64 lineEnd = newline ? newline - data : size;
+
+        std::string_view line(start, size_t(lineEnd - position));
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        std::string_view payload;
+        const FrameStatus status = line.empty() ? FrameStatus::Legacy : unframeRecord(line, payload);
+
+        // Every record is written with its newline, so a last line without one is torn, unless its checksum says
+        // otherwise. An unframed one has no checksum, it's kept if it has all of its fields and the last isn't empty
+        bool good = status != FrameStatus::Corrupt;
+        if (!newline && status == FrameStatus::Legacy) {
+            const int fields = int(std::count(line.begin(), line.end(), '|')) + 1;
+            good = !line.empty() && line.back() != '|' && legacyFields.contains(fields);
+        }
+        if (good) {
+            result.keepSize = newline ? lineEnd + 1 : size;
+            result.missingNewline = !newline;
+            result.corruptRecords += badSinceLastGood;
+            badSinceLastGood = 0;
+        } else {
+            badSinceLastGood++;
+        }
+        position = lineEnd + 1;
+    }
+    result.tornRecords = badSinceLastGood;
+    return result;
+}
+
+void recoverRecordFile(const QString &path, RecoveryReport &report) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    ScanResult result;
+    const qint64 size = file.size();
+    if (size > 0) {
+        QByteArray buffer;
+        const char *data = reinterpret_cast<const char *>(file.map(0, size));
+        if (!data) {
+            buffer = file.readAll();
+            data = buffer.constData();
+        }
+        result = scanRecords(data, size, legacyFieldCounts(QFileInfo(path).fileName()));
+    }
+    file.close(); // Unmaps it too
+    report.filesScanned++;
+    report.bytesScanned += size;
+
+    const QString name = QFileInfo(path).fileName();
+    if (result.corruptRecords > 0) {
+        report.actions.append(QString("%1: %2 damaged record(s) will be skipped").arg(name).arg(result.corruptRecords));
+    }
+    if (result.keepSize < size || result.missingNewline) {
+        QFile fix(path);
+        bool ok = fix.open(QIODevice::ReadWrite) && fix.resize(result.keepSize);
+        if (ok && result.missingNewline) {
+            ok = fix.seek(result.keepSize) && fix.write("\n", 1) == 1;
+        }
+        ok = ok && syncFile(fix);
+        if (result.keepSize < size) {
+            report.actions.append(QString("%1: cut off a torn tail of %2 byte(s) (%3 record(s))%4")
+                                      .arg(name).arg(size - result.keepSize).arg(result.tornRecords)
+                                      .arg(ok ? "" : ", FAILED"));
+        } else {
+            report.actions.append(QString("%1: added the missing newline after the last record%2").arg(name, ok ? "" : ", FAILED"));
+        }
+    }
+}
+
+// The old stock and pending transaction writers both rewrote their file through Data/temp.txt with
+// remove() then rename(). If temp.txt is still there and its file isn't, the crash hit between the two
+// and temp.txt is the complete new version. Which file it was for shows in its field count
+void recoverLegacyTempFile(const QDir &dir, RecoveryReport &report) {
+    const QString tempPath = dir.filePath("temp.txt");
+    QFile temp(tempPath);
+    if (!temp.open(QIODevice::ReadOnly))
+        return;
+    const QByteArray firstLine = temp.readLine();
+    temp.close();
+
+    const int fields = firstLine.count('|') + 1;
+    const QString target = fields == 6 ? "stock_data.txt" : fields == 9 ? "pending_transactions.txt" : QString();
+    if (!target.isEmpty() && !dir.exists(target) && renameDurably(tempPath, dir.filePath(target))) {
+        report.actions.append(QString("temp.txt: moved back to %1, an earlier save was interrupted").arg(target));
+    } else if (QFile::remove(tempPath)) {
+        report.actions.append("temp.txt: removed, left over from an interrupted save");
+    }
+}
+
+// QSaveFile writes "<file>.XXXXXX" and renames it over <file>, one that's still around never got that far
+bool isOrphanedSaveFile(const QString &name) {
+    const int dot = name.lastIndexOf('.');
+    if (dot < 0 || name.size() - dot - 1 != 6)
+        return false;
+    const QString target = name.left(dot);
+    return target.endsWith(".txt") || target.endsWith(".col");
+}
+
+} // namespace
+
+RecoveryReport recoverDataDirectory(const QString &directory) {
+    SARI_TRACE_SCOPE("recoverDataDirectory");
+    RecoveryReport report;
+    QDir dir(directory);
+    if (!dir.exists())
+        return report;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool removedAny = false;
+    for (const QString &name : dir.entryList(QDir::Files)) {
+        if (isOrphanedSaveFile(name) && QFile::remove(dir.filePath(name))) {
+            report.actions.append(QString("%1: removed, left over from an interrupted save").arg(name));
+            removedAny = true;
+        }
+    }
+    recoverLegacyTempFile(dir, report);
+    if (removedAny) {
+        syncDirectory(directory);
+    }
+
+    // Orphans are gone, so what's left is real data
+    for (const QString &name : dir.entryList(QStringList() << "*.txt", QDir::Files)) {
+        recoverRecordFile(dir.filePath(name), report);
+    }
+
+    report.elapsedMs = timer.elapsed();
+    for (const QString &action : report.actions) {
+        qWarning().noquote() << "Recovery:" << action;
+    }
+    qInfo() << "Recovery scan checked" << report.filesScanned << "files," << report.bytesScanned << "bytes in"
+            << report.elapsedMs << "ms";
+    return report;
+}
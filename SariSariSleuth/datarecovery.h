@@ -0,0 +1,28 @@
+#ifndef DATARECOVERY_H
+#define DATARECOVERY_H
+
+#include <QString>
+#include <QStringList>
+
+// What recoverDataDirectory found and fixed
+struct RecoveryReport {
+    QStringList actions; // One line per file it had to touch or warn about
+    int filesScanned = 0;
+    qint64 bytesScanned = 0;
+    qint64 elapsedMs = 0;
+
+    bool isClean() const { return actions.isEmpty(); }
+};
+
+// Run before anything reads the Data directory, at startup and after a restore.
+// - Every text record file is checked record by record (see recordframe.h). A torn or garbled tail,
+//   which is all a crash or power cut mid-append can leave, is cut off so the next append starts on a clean line.
+//   A last line from before the framing that only lacks its newline gets it back, if it has all of its fields.
+//   Bad records further in are only reported, the readers skip them.
+// - Temporary files from an interrupted atomic replace are removed. The "temp.txt" the old stock
+//   writer used is moved back into place if it never got renamed over stock_data.txt.
+// The files are memory mapped and checked with the hardware CRC, so this runs at about disk speed.
+// Binary history columns are checked by BinaryHistory::read.
+RecoveryReport recoverDataDirectory(const QString &directory);
+
+#endif // DATARECOVERY_H
@@ -0,0 +1,109 @@
+#include "diagnosticspage.h"
+#include "metrics.h"
+#include "iothread.h"
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <cstring>
+
+namespace {
+
+QString formatValue(qint64 value, const char *unit) {
+    if (std::strcmp(unit, "B") == 0) {
+        if (value < 1024)
+            return QString("%1 B").arg(value);
+        if (value < 1024 * 1024)
+            return QString("%1 KB").arg(value / 1024.0, 0, 'f', 1);
+        return QString("%1 MB").arg(value / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    if (value < 1000)
+        return QString("%1 ns").arg(value);
+    if (value < 1000000)
+        return QString("%1 µs").arg(value / 1e3, 0, 'f', 1);
+    if (value < 1000000000)
+        return QString("%1 ms").arg(value / 1e6, 0, 'f', 1);
+    return QString("%1 s").arg(value / 1e9, 0, 'f', 2);
+}
+
+} // namespace
+
+// CONSTRUCTOR
+DiagnosticsPage::DiagnosticsPage(const AnalyticsScheduler *scheduler, QWidget *parent)
+    : QWidget(parent)
+    , scheduler(scheduler)
+    , summary(new QLabel(this))
+    , table(new QTableWidget(this)) {
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QLabel *title = new QLabel("Diagnostics", this);
+    title->setStyleSheet("font: 700 14pt \"Montserrat\";");
+    layout->addWidget(title);
+    layout->addWidget(summary);
+    layout->addWidget(table);
+
+    table->setColumnCount(7);
+    table->setHorizontalHeaderLabels({"Operation", "Count", "p50", "p95", "p99", "Max", "Per second"});
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    table->verticalHeader()->setVisible(false);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionMode(QAbstractItemView::NoSelection);
+
+    refreshTimer.setInterval(1000);
+    connect(&refreshTimer, &QTimer::timeout, this, &DiagnosticsPage::refresh);
+}
+
+void DiagnosticsPage::showEvent(QShowEvent *event) {
+    refresh();
+    refreshTimer.start();
+    QWidget::showEvent(event);
+}
+
+void DiagnosticsPage::hideEvent(QHideEvent *event) {
+    refreshTimer.stop(); // Nobody's looking
+    QWidget::hideEvent(event);
+}
+
+void DiagnosticsPage::refresh() {
+
+    // Called by the refresh timer, once a second while the page is showing
+
+    const double uptime = Metrics::uptimeSeconds();
+    const QVector<Metrics::LatencyHistogram*> &histograms = Metrics::histograms();
+    const QVector<Metrics::Counter*> &counters = Metrics::counters();
+    table->setRowCount(histograms.size() + counters.size());
+
+    int row = 0;
+    for (const Metrics::LatencyHistogram *histogram : histograms) {
+        const Metrics::LatencyHistogram::Snapshot snapshot = histogram->snapshot();
+        const char *unit = histogram->unit();
+        const QStringList cells = {
+            histogram->name(),
+            QString::number(snapshot.count),
+            snapshot.count ? formatValue(snapshot.percentile(50), unit) : "-",
+            snapshot.count ? formatValue(snapshot.percentile(95), unit) : "-",
+            snapshot.count ? formatValue(snapshot.percentile(99), unit) : "-",
+            snapshot.count ? formatValue(snapshot.max, unit) : "-",
+            QString::number(uptime > 0 ? snapshot.count / uptime : 0.0, 'f', 2)
+        };
+        for (int column = 0; column < cells.size(); column++) {
+            table->setItem(row, column, new QTableWidgetItem(cells[column]));
+        }
+        row++;
+    }
+    for (const Metrics::Counter *counter : counters) {
+        const quint64 value = counter->value.load(std::memory_order_relaxed);
+        table->setItem(row, 0, new QTableWidgetItem(counter->name));
+        table->setItem(row, 1, new QTableWidgetItem(QString::number(value)));
+        for (int column = 2; column < 6; column++) {
+            table->setItem(row, column, new QTableWidgetItem("-"));
+        }
+        table->setItem(row, 6, new QTableWidgetItem(QString::number(uptime > 0 ? value / uptime : 0.0, 'f', 2)));
+        row++;
+    }
+
+    const qint64 seconds = qint64(uptime);
+    summary->setText(QString("Up %1:%2:%3 - %4 bytes written, %5 flushes, %6 fsyncs, %7 appends group committed, %8 I/O failures\n"
+                             "Analytics: %9 refreshes asked for, %10 folded into one already pending, %11 run")
+                         .arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'))
+                         .arg(IoThread::bytesWrittenCount()).arg(IoThread::flushCount()).arg(IoThread::syncCount())
+                         .arg(IoThread::coalescedCount()).arg(IoThread::failureCount())
+                         .arg(scheduler->requestedCount()).arg(scheduler->coalescedCount()).arg(scheduler->executedCount()));
+}
@@ -0,0 +1,31 @@
+#ifndef DIAGNOSTICSPAGE_H
+#define DIAGNOSTICSPAGE_H
+
+#include <QLabel>
+#include <QTableWidget>
+#include <QTimer>
+#include <QWidget>
+#include "analyticsscheduler.h"
+
+// Hidden page of the stacked widget (key 5) with what the Metrics namespace has seen since launch:
+// count, p50/p95/p99, max and throughput per operation. Only refreshes while it's on screen.
+class DiagnosticsPage : public QWidget {
+    Q_OBJECT
+
+    private:
+        const AnalyticsScheduler *scheduler; // Only read, for its refresh counts
+        QLabel *summary;
+        QTableWidget *table;
+        QTimer refreshTimer;
+
+        void refresh();
+
+    protected:
+        void showEvent(QShowEvent *event) override;
+        void hideEvent(QHideEvent *event) override;
+
+    public:
+        explicit DiagnosticsPage(const AnalyticsScheduler *scheduler, QWidget *parent = nullptr);
+};
+
+#endif // DIAGNOSTICSPAGE_H
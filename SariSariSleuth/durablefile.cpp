@@ -0,0 +1,57 @@
+#include "durablefile.h"
+#include "metrics.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool syncFile(QFileDevice &file) {
+    if (!file.flush())
+        return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool syncDirectory(const QString &directory) {
+#ifdef Q_OS_WIN
+    Q_UNUSED(directory); // NTFS journals the rename itself, and a directory can't be opened for syncing anyway
+    return true;
+#else
+    const int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return false;
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool replaceFileDurably(const QString &path, const QByteArray &contents) {
+    Metrics::ScopedTimer timer(Metrics::fileRewrite);
+    Metrics::fileRewriteSize.record(contents.size());
+    Metrics::fileRewriteBytes.add(quint64(contents.size()));
+    const QString directory = QFileInfo(path).path();
+    QDir().mkpath(directory);
+
+    QSaveFile out(path); // "<path>.XXXXXX" until commit, the startup recovery removes any left behind
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    if (out.write(contents) != contents.size() || !syncFile(out)) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit() && syncDirectory(directory);
+}
+
+bool renameDurably(const QString &from, const QString &to) {
+    return QFile::rename(from, to) && syncDirectory(QFileInfo(to).path());
+}
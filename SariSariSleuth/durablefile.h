@@ -0,0 +1,18 @@
+#ifndef DURABLEFILE_H
+#define DURABLEFILE_H
+
+#include <QByteArray>
+#include <QFileDevice>
+#include <QString>
+
+// The pieces needed to make a file change survive a power cut, not just a crash
+
+bool syncFile(QFileDevice &file); // fsync, after a flush
+bool syncDirectory(const QString &directory); // A rename or a new file isn't durable until its directory is synced
+
+// Writes contents to a temporary file next to path, syncs it, renames it over path and syncs the directory.
+// Afterwards path holds either the old or the new contents, never a mix or nothing
+bool replaceFileDurably(const QString &path, const QByteArray &contents);
+bool renameDurably(const QString &from, const QString &to); // to must not exist
+
+#endif // DURABLEFILE_H
@@ -1,5 +1,5 @@
 #include "howmuchmodel.h"
-#include <QFont>
+#include "trace.h"
 #include <cmath>
 
 HowMuchModel::HowMuchModel(QObject *parent)
@@ -23,35 +23,28 @@ QVariant HowMuchModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole) {
         return QString("%1 - Stock: %2").arg(recommendation.productName).arg(QString::number(recommendation.amountToStock, 'f', 0));
     }
-    else if (role == Qt::FontRole && recommendation.isOutOfStock) {
-        QFont font;
-        font.setBold(true);
-        return font;
+    else if (role == OutOfStockRole) {
+        return recommendation.isOutOfStock; // HowMuchStyleProxy turns this into a bold font
     }
 
     return QVariant();
 }
 
 void HowMuchModel::updateRecommendations(const QVector<ProductAnalytics>& analytics, int daysToStock, const StockModel* stockModel) {
+    SARI_TRACE_SCOPE("HowMuchModel::updateRecommendations");
 
-    // Called by onDaysToStockChanged and onTimePeriodChanged
+    // Called by onDaysToStockChanged and onAnalyticsReady
     beginResetModel();
     recommendations.clear();
+    recommendations.reserve(analytics.size());
 
     for (const ProductAnalytics &analytic : analytics) {
         StockRecommendation recommendation;
         recommendation.productName = analytic.productName;
         recommendation.amountToStock = 1.65 * analytic.salesRate * std::sqrt(daysToStock);
         
-        // Check if item is out of stock
-        recommendation.isOutOfStock = false;
-        for (int i = 0; i < stockModel->rowCount(); ++i) {
-            StockItem item = stockModel->getItem(i);
-            if (item.productName == analytic.productName && item.remaining == 0) {
-                recommendation.isOutOfStock = true;
-                break;
-            }
-        }
+        // Check if item is out of stock, a hash lookup on the whole stock so the stock filter doesn't hide anything
+        recommendation.isOutOfStock = stockModel->isOutOfStock(analytic.productName);
         
         recommendations.append(recommendation);
     }
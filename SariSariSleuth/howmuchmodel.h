@@ -20,6 +20,10 @@ class HowMuchModel : public QAbstractListModel {
         int daysToStock;
 
     public:
+        enum HowMuchRole { // No fonts or colors in here, the GUI styles the rows from these
+            OutOfStockRole = Qt::UserRole + 1
+        };
+
         explicit HowMuchModel(QObject *parent = nullptr);
 
     // Required overrides for QAbstractListModel
@@ -0,0 +1,18 @@
+#include "howmuchstyleproxy.h"
+#include "howmuchmodel.h"
+#include <QFont>
+
+// CONSTRUCTOR
+HowMuchStyleProxy::HowMuchStyleProxy(QAbstractItemModel *source, QObject *parent)
+    : QIdentityProxyModel(parent) {
+    setSourceModel(source);
+}
+
+QVariant HowMuchStyleProxy::data(const QModelIndex &index, int role) const {
+    if (role == Qt::FontRole && QIdentityProxyModel::data(index, HowMuchModel::OutOfStockRole).toBool()) {
+        QFont font;
+        font.setBold(true);
+        return font;
+    }
+    return QIdentityProxyModel::data(index, role);
+}
@@ -0,0 +1,16 @@
+#ifndef HOWMUCHSTYLEPROXY_H
+#define HOWMUCHSTYLEPROXY_H
+
+#include <QIdentityProxyModel>
+
+// Sits between HowMuchModel and its list view and adds the styling the core library can't:
+// out of stock recommendations show up in bold.
+class HowMuchStyleProxy : public QIdentityProxyModel {
+    Q_OBJECT
+
+    public:
+        explicit HowMuchStyleProxy(QAbstractItemModel *source, QObject *parent = nullptr);
+        QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+};
+
+#endif // HOWMUCHSTYLEPROXY_H
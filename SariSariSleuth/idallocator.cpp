@@ -0,0 +1,73 @@
+#include "idallocator.h"
+#include <climits>
+
+IdAllocator::IdAllocator() {
+    clear();
+}
+
+void IdAllocator::clear() {
+    freeRanges.clear();
+    freeRanges[1] = INT_MAX; // Ids start from 1
+}
+
+bool IdAllocator::isFree(int id) const {
+    auto it = freeRanges.upper_bound(id); // First range starting after id
+    if (it == freeRanges.begin())
+        return false;
+    --it;
+    return id <= it->second;
+}
+
+void IdAllocator::reserve(int id) {
+    if (id <= 0 || !isFree(id))
+        return;
+
+    // Split the range it's in, whatever is left on either side stays free
+    auto it = std::prev(freeRanges.upper_bound(id));
+    const int first = it->first;
+    const int last = it->second;
+    freeRanges.erase(it);
+    if (first < id)
+        freeRanges[first] = id - 1;
+    if (id < last)
+        freeRanges[id + 1] = last;
+}
+
+void IdAllocator::release(int id) {
+    if (!isUsed(id))
+        return;
+
+    // Merge with the ranges right before and after it, if there are any
+    int first = id;
+    int last = id;
+    if (id < INT_MAX) {
+        auto next = freeRanges.find(id + 1);
+        if (next != freeRanges.end()) {
+            last = next->second;
+            freeRanges.erase(next);
+        }
+    }
+    auto previous = freeRanges.lower_bound(id);
+    if (previous != freeRanges.begin()) {
+        --previous;
+        if (previous->second == id - 1) {
+            first = previous->first;
+            freeRanges.erase(previous);
+        }
+    }
+    freeRanges[first] = last;
+}
+
+int IdAllocator::lowestFree() const {
+    return freeRanges.empty() ? -1 : freeRanges.begin()->first;
+}
+
+int IdAllocator::allocate() {
+    int id = lowestFree();
+    reserve(id);
+    return id;
+}
+
+bool IdAllocator::isUsed(int id) const {
+    return id > 0 && !isFree(id);
+}
@@ -0,0 +1,25 @@
+#ifndef IDALLOCATOR_H
+#define IDALLOCATOR_H
+
+#include <map>
+
+// Hands out the lowest id that isn't in use, starting from 1.
+// The free ids are kept as ranges, so one huge id read from a file costs a range split and not
+// an entry per id skipped over. Every operation is O(log n) in the number of gaps.
+class IdAllocator {
+    private:
+        std::map<int, int> freeRanges; // First id of a free range -> its last id, never overlapping or touching
+        bool isFree(int id) const;
+
+    public:
+        IdAllocator();
+
+        void clear();
+        void reserve(int id); // Marks an id as taken, e.g. when it is read from a file
+        void release(int id); // Gives an id back
+        int lowestFree() const; // Doesn't take the id, call reserve once it's actually used. -1 once every id is taken
+        int allocate(); // lowestFree + reserve
+        bool isUsed(int id) const;
+};
+
+#endif // IDALLOCATOR_H
@@ -0,0 +1,226 @@
+#include "inventoryservice.h"
+#include "trace.h"
+#include "metrics.h"
+#include "iothread.h"
+#include <QHash>
+#include <algorithm>
+
+struct InventoryService::Confirm {
+    QVector<int> rows; // Ascending, no duplicates
+    QVector<Transaction> removed; // What was at rows, to put back if the pending step fails
+    QVector<Transaction> sales;
+    QVector<StockItem> stockChanges;
+    QVector<StockItem> stockRollback; // The same items as they were before
+    ConfirmResult result;
+    qint64 startedAt = 0; // For Metrics::saleConfirm
+};
+
+// CONSTRUCTOR
+InventoryService::InventoryService(StockModel *stockModel, TransactionModel *transactionModel, ConfirmedTransactionModel *confirmedTransactionModel,
+                                   QObject *parent)
+    : QObject(parent)
+    , stockModel(stockModel)
+    , transactionModel(transactionModel)
+    , confirmedTransactionModel(confirmedTransactionModel)
+    , confirming(false) {
+}
+
+bool InventoryService::confirmPending(QVector<int> rows, const LowStockHandler &lowStock) {
+    SARI_TRACE_SCOPE("InventoryService::confirmPending");
+
+    // Called by onConfirmTransactionClicked with every selected row
+
+    if (confirming)
+        return false;
+
+    auto confirm = std::make_shared<Confirm>();
+    confirm->startedAt = Metrics::now();
+    ConfirmResult &result = confirm->result;
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    // Work out the whole batch on copies first, nothing is written until it's all known
+    QHash<int, StockItem> updated; // Item id -> stock after the batch
+    QHash<int, StockItem> previous; // Item id -> stock before the batch, for rolling back
+    QVector<int> touched; // Item ids in the order they were first seen
+    QVector<Transaction> &sales = confirm->sales; // What goes into the history, with the quantity actually sold
+    int lowStockAnswer = -1; // Asked at most once per batch, -1 until then
+
+    for (int row : rows) {
+        Transaction transaction = transactionModel->getTransaction(row);
+        confirm->removed.append(transaction);
+
+        auto it = updated.find(transaction.itemId);
+        if (it == updated.end()) {
+            const StockItem *stocked = stockModel->findById(transaction.itemId); // Hash lookup, works even if the item is filtered out
+            if (!stocked) {
+                result.dropped++; // Not in stock anymore, it still leaves the pending list
+                continue;
+            }
+            previous.insert(stocked->id, *stocked);
+            it = updated.insert(stocked->id, *stocked);
+            touched.append(stocked->id);
+        }
+        StockItem &item = it.value();
+
+        int quantity = transaction.quantity;
+        if (item.remaining < quantity) {
+            if (lowStockAnswer < 0) {
+                const qint64 asked = Metrics::now();
+                lowStockAnswer = lowStock && lowStock(item, quantity) ? 1 : 0;
+                confirm->startedAt += Metrics::now() - asked; // The cashier reading the question isn't the app being slow
+            }
+            if (lowStockAnswer == 0) {
+                result.dropped++; // Not sold, but it still leaves the pending list
+                continue;
+            }
+            quantity = item.remaining;
+        }
+        item.remaining -= quantity;
+        item.sold += quantity;
+        transaction.quantity = quantity;
+        sales.append(transaction);
+    }
+
+    for (int id : touched) {
+        if (!(updated[id] == previous[id])) {
+            confirm->stockChanges.append(updated[id]);
+            confirm->stockRollback.append(previous[id]);
+        }
+    }
+    confirm->rows = rows;
+
+    // One history append, one journal write, one tombstone append, each settled on the I/O thread before the
+    // next is queued. Nothing here waits for them, every step carries on from IoThread::whenDone on the GUI thread.
+    // Whichever fails undoes the ones before it, so a failure on the I/O thread can't leave half a sale behind
+    confirming = true;
+    WriteCompletions written;
+    if (!confirmedTransactionModel->addTransactions(sales, &written)) {
+        result.status = ConfirmStatus::HistoryFailed;
+        finish(confirm);
+        return true;
+    }
+    IoThread::instance().whenDone(written, this, [this, confirm](bool ok) { afterHistory(confirm, ok); });
+    return true;
+}
+
+void InventoryService::afterHistory(const std::shared_ptr<Confirm> &confirm, bool written) {
+    SARI_TRACE_SCOPE("InventoryService::afterHistory");
+    if (!written) {
+        confirm->result.status = ConfirmStatus::HistoryFailed;
+        rollBack(confirm, false, false, true); // The model already shows the rows
+        return;
+    }
+    if (confirm->stockChanges.isEmpty()) { // Nothing to write if every row was dropped
+        afterStock(confirm, true);
+        return;
+    }
+
+    WriteCompletions stockWritten;
+    if (!stockModel->updateItemsById(confirm->stockChanges, &stockWritten)) { // Leaves the stock as it was
+        confirm->result.status = ConfirmStatus::StockFailed;
+        rollBack(confirm, false, false, true);
+        return;
+    }
+    IoThread::instance().whenDone(stockWritten, this, [this, confirm](bool ok) { afterStock(confirm, ok); });
+}
+
+void InventoryService::afterStock(const std::shared_ptr<Confirm> &confirm, bool written) {
+    SARI_TRACE_SCOPE("InventoryService::afterStock");
+    if (!written) {
+        confirm->result.status = ConfirmStatus::StockFailed;
+        rollBack(confirm, false, true, true);
+        return;
+    }
+
+    WriteCompletions pendingWritten;
+    if (!transactionModel->removeTransactions(confirm->rows, &pendingWritten)) { // Leaves the pending list as it was
+        confirm->result.status = ConfirmStatus::PendingFailed;
+        rollBack(confirm, false, true, true);
+        return;
+    }
+    IoThread::instance().whenDone(pendingWritten, this, [this, confirm](bool ok) { afterPending(confirm, ok); });
+}
+
+void InventoryService::afterPending(const std::shared_ptr<Confirm> &confirm, bool written) {
+    SARI_TRACE_SCOPE("InventoryService::afterPending");
+    if (!written) {
+        confirm->result.status = ConfirmStatus::PendingFailed;
+        rollBack(confirm, true, true, true);
+        return;
+    }
+
+    // No analytics refresh here, the new history rows and the stock change already marked them stale
+    confirm->result.sold = confirm->sales.size();
+    finish(confirm);
+}
+
+void InventoryService::rollBack(const std::shared_ptr<Confirm> &confirm, bool pending, bool stock, bool history) {
+    SARI_TRACE_SCOPE("InventoryService::rollBack");
+
+    // Called by the steps above with what's done so far. The undo goes through the I/O thread like
+    // everything else, and only counts once it has settled too
+
+    WriteCompletions undone;
+    bool queued = true;
+    if (pending) {
+        queued = transactionModel->restoreTransactions(confirm->rows, confirm->removed, &undone) && queued;
+    }
+    if (stock && !confirm->stockRollback.isEmpty()) {
+        queued = stockModel->updateItemsById(confirm->stockRollback, &undone) && queued;
+    }
+    if (history) {
+        queued = confirmedTransactionModel->removeLastTransactions(confirm->sales.size(), &undone) && queued;
+    }
+
+    if (!queued) {
+        confirm->result.status = ConfirmStatus::RollbackFailed;
+        finish(confirm);
+        return;
+    }
+    IoThread::instance().whenDone(undone, this, [this, confirm](bool ok) {
+        if (!ok)
+            confirm->result.status = ConfirmStatus::RollbackFailed;
+        finish(confirm);
+    });
+}
+
+void InventoryService::finish(const std::shared_ptr<Confirm> &confirm) {
+    Metrics::saleConfirm.record(Metrics::now() - confirm->startedAt);
+    confirming = false;
+    emit confirmFinished(confirm->result);
+}
+
+StockItem InventoryService::addItem(const QString &productName, double price, int stock) {
+    SARI_TRACE_SCOPE("InventoryService::addItem");
+
+    // Called by onAddButtonClicked
+
+    StockItem item;
+    item.id = stockModel->nextFreeId(); // Lowest unused id across the whole stock, not just the filtered rows
+    item.productName = productName;
+    item.price = price;
+    item.stock = stock;
+    item.remaining = stock;
+    item.sold = 0;
+
+    stockModel->addItem(item);
+    return item;
+}
+
+bool InventoryService::editItem(int itemId, const QString &productName, double price, int stock) {
+    SARI_TRACE_SCOPE("InventoryService::editItem");
+
+    // Called by onEditButtonClicked
+
+    const StockItem *current = stockModel->findById(itemId);
+    if (!current)
+        return false;
+
+    StockItem item = *current;
+    item.productName = productName;
+    item.price = price;
+    item.stock = stock;
+    item.remaining = item.stock - item.sold;
+    return stockModel->updateItemById(itemId, item);
+}
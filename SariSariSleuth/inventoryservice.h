@@ -0,0 +1,65 @@
+#ifndef INVENTORYSERVICE_H
+#define INVENTORYSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include "stockmodel.h"
+#include "transactionmodel.h"
+#include "confirmedtransactionmodel.h"
+
+// The shop's rules on top of the three models: confirming pending sales into the history, and
+// adding or editing stock. No widgets in here, whatever needs asking goes through a callback,
+// so the GUI, the benchmarks and any headless tool all run the same code.
+class InventoryService : public QObject {
+    Q_OBJECT
+
+    private:
+        StockModel *stockModel;
+        TransactionModel *transactionModel;
+        ConfirmedTransactionModel *confirmedTransactionModel;
+        bool confirming; // A confirm is between its steps, see confirmPending
+
+        struct Confirm; // Everything one confirm carries from one step to the next
+        void afterHistory(const std::shared_ptr<Confirm> &confirm, bool written);
+        void afterStock(const std::shared_ptr<Confirm> &confirm, bool written);
+        void afterPending(const std::shared_ptr<Confirm> &confirm, bool written);
+        void rollBack(const std::shared_ptr<Confirm> &confirm, bool pending, bool stock, bool history); // Undoes the steps named, then finishes
+        void finish(const std::shared_ptr<Confirm> &confirm);
+
+    public:
+        enum class ConfirmStatus {
+            Confirmed,
+            HistoryFailed, // Nothing was confirmed
+            StockFailed, // Nothing was confirmed, the history got rolled back
+            PendingFailed, // Nothing was confirmed, the history and the stock got rolled back
+            RollbackFailed // A step failed and so did undoing the ones before it, the files and the models may disagree
+        };
+
+        struct ConfirmResult {
+            ConfirmStatus status = ConfirmStatus::Confirmed;
+            int sold = 0; // Transactions that went into the history
+            int dropped = 0; // Left the pending list without a sale: the item is gone, or it ran out and the answer was no
+        };
+
+        // Asked at most once per batch, the first time an item would run out. item is the stock as it
+        // stands at that point of the batch. true sells what's left of it, and of every other item that runs out
+        using LowStockHandler = std::function<bool(const StockItem &item, int quantity)>;
+
+        InventoryService(StockModel *stockModel, TransactionModel *transactionModel, ConfirmedTransactionModel *confirmedTransactionModel,
+                         QObject *parent = nullptr);
+
+        // Rows of the pending transactions, all or nothing. Returns once the first write is queued, confirmFinished
+        // says how it went. false without doing anything if another confirm hasn't finished yet
+        bool confirmPending(QVector<int> rows, const LowStockHandler &lowStock);
+        bool isConfirming() const { return confirming; } // Nothing else should change the models meanwhile, a rollback would undo it
+        StockItem addItem(const QString &productName, double price, int stock); // Takes the lowest free id
+        bool editItem(int itemId, const QString &productName, double price, int stock); // What's been sold stays sold, remaining follows stock
+
+    signals:
+        void confirmFinished(const InventoryService::ConfirmResult &result);
+};
+
+#endif // INVENTORYSERVICE_H
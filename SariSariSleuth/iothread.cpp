@@ -0,0 +1,368 @@
+#include "iothread.h"
+#include "trace.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include "durablefile.h"
+#include <algorithm>
+#include <chrono>
+
+std::atomic<quint64> IoThread::totalBytes{0};
+std::atomic<quint64> IoThread::totalFlushes{0};
+std::atomic<quint64> IoThread::totalSyncs{0};
+std::atomic<quint64> IoThread::totalCoalesced{0};
+std::atomic<quint64> IoThread::totalFailures{0};
+
+// A file the I/O thread has open, with the appends that haven't gone out yet
+struct IoThread::OpenFile {
+    QFile file;
+    DurabilityPolicy policy;
+    QByteArray pending;
+    int pendingWrites = 0;
+    QElapsedTimer oldestPending; // Started when pending stops being empty, for Batched
+
+    struct Waiter { // One per pending append
+        std::shared_ptr<std::promise<bool>> done;
+        std::shared_ptr<WriterStats> stats;
+        qint64 bytes;
+    };
+    std::vector<Waiter> waiters;
+};
+
+IoThread &IoThread::instance() {
+    static IoThread thread;
+    return thread;
+}
+
+// CONSTRUCTOR
+IoThread::IoThread() {
+    worker = std::thread(&IoThread::loop, this);
+}
+
+// DESTRUCTOR
+IoThread::~IoThread() {
+    shutdown();
+}
+
+void IoThread::shutdown() {
+    if (!worker.joinable())
+        return;
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    worker.join();
+}
+
+IoThread::Completion IoThread::submit(Command command) {
+    command.done = std::make_shared<std::promise<bool>>();
+    Completion completion = command.done->get_future().share();
+
+    if (!worker.joinable()) { // Already shut down, nothing will ever run it
+        command.done->set_value(false);
+        return completion;
+    }
+
+    queue.push(std::move(command));
+    if (sleeping.load()) { // Only pay for the lock when the thread is actually parked
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    return completion;
+}
+
+IoThread::Completion IoThread::append(const QString &path, const QByteArray &data, const DurabilityPolicy &policy,
+                                      const std::shared_ptr<WriterStats> &stats) {
+    Command command;
+    command.type = Command::Append;
+    command.path = path;
+    command.data = data; // Implicitly shared, the I/O thread only reads it
+    command.policy = policy;
+    command.stats = stats;
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::truncate(const QString &path, qint64 size) {
+    Command command;
+    command.type = Command::Truncate;
+    command.path = path;
+    command.size = size;
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::close(const QString &path) {
+    Command command;
+    command.type = Command::Close;
+    command.path = path;
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::replace(const QString &path, const QByteArray &contents) {
+    Command command;
+    command.type = Command::Replace;
+    command.path = path;
+    command.data = contents;
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::remove(const QString &path) {
+    Command command;
+    command.type = Command::Remove;
+    command.path = path;
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::run(std::function<bool()> task) {
+    Command command;
+    command.type = Command::Task;
+    command.task = std::move(task);
+    return submit(std::move(command));
+}
+
+IoThread::Completion IoThread::barrier() {
+    Command command;
+    command.type = Command::Barrier;
+    return submit(std::move(command));
+}
+
+void IoThread::whenDone(WriteCompletions writes, QObject *context, std::function<void(bool)> then) {
+    Command command;
+    command.type = Command::Notify;
+    QPointer<QObject> guard(context);
+    command.task = [writes = std::move(writes), guard, then = std::move(then)]() {
+        bool ok = true;
+        for (const Completion &write : writes) {
+            ok = (!write.valid() || write.get()) && ok; // All queued before this, so they're settled and get() doesn't wait
+        }
+        if (QCoreApplication *app = QCoreApplication::instance()) {
+            QMetaObject::invokeMethod(app, [guard, then, ok]() {
+                if (guard)
+                    then(ok);
+            }, Qt::QueuedConnection);
+        }
+        return ok;
+    };
+    submit(std::move(command));
+}
+
+// EVERYTHING BELOW RUNS ON THE I/O THREAD
+
+void IoThread::loop() {
+    Trace::setThreadName("I/O thread");
+    while (true) {
+        {
+            // Park until there's a command, or until the oldest Batched append is due
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            sleeping.store(true);
+            if (queue.empty() && !stopping.load()) {
+                const qint64 dueIn = msUntilNextDeadline();
+                wake.wait_for(lock, std::chrono::milliseconds(dueIn >= 0 ? dueIn : 100)); // Never parks for good, just in case
+            }
+            sleeping.store(false);
+        }
+
+        Command command;
+        bool first = true;
+        while (queue.pop(command)) {
+            if (first && command.type == Command::Append && command.policy.mode == DurabilityPolicy::SyncOnCommit) {
+                // An fsync is expensive, give whoever else is about to append a moment to join it
+                std::this_thread::sleep_for(std::chrono::microseconds(GROUP_COMMIT_WINDOW_US));
+            }
+            first = false;
+            execute(command);
+        }
+        flushDue();
+
+        if (stopping.load() && queue.empty()) {
+            flushAll();
+            closeAll();
+            return;
+        }
+    }
+}
+
+void IoThread::execute(Command &command) {
+    bool ok = true;
+    switch (command.type) {
+        case Command::Append: {
+            OpenFile &open = file(command.path);
+            open.policy = command.policy;
+            if (open.pending.isEmpty()) {
+                open.oldestPending.start();
+            } else {
+                totalCoalesced++;
+            }
+            open.pending.append(command.data);
+            open.pendingWrites++;
+            open.waiters.push_back(OpenFile::Waiter{command.done, command.stats, command.data.size()});
+            if (open.policy.mode == DurabilityPolicy::Batched && open.pendingWrites >= open.policy.maxRecords) {
+                flushFile(open);
+            }
+            return; // Completed when the group goes out
+        }
+        case Command::Truncate: {
+            SARI_TRACE_SCOPE("IoThread::truncate");
+            OpenFile &open = file(command.path);
+            flushFile(open); // Anything queued before the truncate goes out first, then gets cut
+            ok = open.file.isOpen() ? open.file.resize(command.size) : QFile::resize(command.path, command.size);
+            break;
+        }
+        case Command::Close:
+            closeFile(command.path);
+            break;
+        case Command::Replace: {
+            SARI_TRACE_SCOPE("IoThread::replace");
+            closeFile(command.path);
+            ok = replaceFileDurably(command.path, command.data);
+            break;
+        }
+        case Command::Remove:
+            closeFile(command.path);
+            ok = !QFile::exists(command.path) || QFile::remove(command.path);
+            break;
+        case Command::Task: {
+            SARI_TRACE_SCOPE("IoThread::task");
+            ok = flushAll(); // The task may read, rename or replace any file
+            closeAll();
+            ok = command.task() && ok;
+            break;
+        }
+        case Command::Barrier: {
+            SARI_TRACE_SCOPE("IoThread::barrier");
+            ok = flushAll();
+            break;
+        }
+        case Command::Notify:
+            flushAll(); // Settles every append queued before it, a Batched one included
+            command.task(); // A write that failed was already counted when it did
+            break;
+    }
+    if (!ok) {
+        totalFailures++;
+    }
+    command.done->set_value(ok);
+}
+
+IoThread::OpenFile &IoThread::file(const QString &path) {
+    std::unique_ptr<OpenFile> &open = files[path.toStdString()];
+    if (!open) {
+        open = std::make_unique<OpenFile>();
+        open->file.setFileName(path);
+    }
+    return *open;
+}
+
+bool IoThread::flushFile(OpenFile &open) {
+    if (open.pending.isEmpty())
+        return true;
+    SARI_TRACE_SCOPE("IoThread::flushFile"); // Only the ones that write something
+
+    const bool sync = open.policy.mode == DurabilityPolicy::SyncOnCommit;
+    bool ok = open.file.isOpen();
+    if (!ok) {
+        const QString directory = QFileInfo(open.file.fileName()).path();
+        QDir().mkpath(directory);
+        const bool created = !open.file.exists();
+        ok = open.file.open(QIODevice::WriteOnly | QIODevice::Append);
+        if (ok && created && sync) {
+            syncDirectory(directory); // Otherwise the fsync'd records could vanish along with the file itself
+        }
+    }
+
+    const qint64 sizeBefore = ok ? open.file.size() : 0;
+    ok = ok && open.file.write(open.pending) == open.pending.size() && open.file.flush();
+    if (ok && sync) {
+        ok = syncFile(open.file);
+        totalSyncs++;
+    }
+
+    if (ok) {
+        totalBytes += open.pending.size();
+        totalFlushes++;
+    } else {
+        if (open.file.isOpen()) {
+            open.file.resize(sizeBefore); // A partial group would read back as torn records
+        }
+        totalFailures++;
+        qWarning() << "Failed to write" << open.pendingWrites << "records to" << open.file.fileName();
+    }
+
+    // The whole group shares one outcome
+    WriterStats *counted = nullptr;
+    for (const OpenFile::Waiter &waiter : open.waiters) {
+        if (WriterStats *stats = waiter.stats.get()) {
+            if (!ok) {
+                stats->failed.store(true);
+            } else {
+                stats->bytesWritten += waiter.bytes;
+                if (stats != counted) { // One flush per writer, however many of its appends were in the group
+                    stats->flushes++;
+                    if (sync)
+                        stats->syncs++;
+                    counted = stats;
+                }
+            }
+        }
+        waiter.done->set_value(ok);
+    }
+
+    open.pending.clear();
+    open.pendingWrites = 0;
+    open.waiters.clear();
+    return ok;
+}
+
+bool IoThread::flushAll() {
+    bool ok = true;
+    for (auto &entry : files) {
+        ok = flushFile(*entry.second) && ok;
+    }
+    return ok;
+}
+
+void IoThread::closeFile(const QString &path) {
+    auto it = files.find(path.toStdString());
+    if (it == files.end())
+        return;
+    flushFile(*it->second);
+    it->second->file.close();
+    files.erase(it);
+}
+
+void IoThread::closeAll() {
+    for (auto &entry : files) {
+        flushFile(*entry.second);
+        entry.second->file.close();
+    }
+    files.clear();
+}
+
+qint64 IoThread::msUntilNextDeadline() const {
+    qint64 soonest = -1;
+    for (const auto &entry : files) {
+        const OpenFile &open = *entry.second;
+        if (open.pending.isEmpty())
+            continue;
+        const qint64 delay = open.policy.mode == DurabilityPolicy::Batched ? open.policy.maxDelayMs : 0;
+        const qint64 dueIn = std::max<qint64>(0, delay - open.oldestPending.elapsed());
+        if (soonest < 0 || dueIn < soonest)
+            soonest = dueIn;
+    }
+    return soonest;
+}
+
+void IoThread::flushDue() {
+    for (auto &entry : files) {
+        OpenFile &open = *entry.second;
+        if (open.pending.isEmpty())
+            continue;
+        if (open.policy.mode != DurabilityPolicy::Batched || open.oldestPending.elapsed() >= open.policy.maxDelayMs) {
+            flushFile(open); // Everything that piled up in this round is one group
+        }
+    }
+}
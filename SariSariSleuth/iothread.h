@@ -0,0 +1,106 @@
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "mpscqueue.h"
+#include "recordwriter.h"
+
+class QObject;
+
+// Counters for one RecordWriter, updated by the I/O thread
+struct WriterStats {
+    std::atomic<bool> failed{false}; // A write didn't make it, so the writer's idea of the file size is off
+    std::atomic<quint64> bytesWritten{0};
+    std::atomic<quint64> flushes{0};
+    std::atomic<quint64> syncs{0};
+};
+
+// The one thread that touches the data files. Every model hands it commands through a lock-free
+// queue and carries on; the thread runs them in the order they were queued. Appends to the same file
+// that pile up while it is busy (or within GROUP_COMMIT_WINDOW_US for fsync'd files) go out as a single
+// write and a single fsync. Every command gives back a future for the callers that need to wait.
+class IoThread {
+    public:
+        using Completion = std::shared_future<bool>; // true once the command's effect is on disk
+
+        static IoThread &instance(); // Started on first use
+        ~IoThread();
+
+        Completion append(const QString &path, const QByteArray &data, const DurabilityPolicy &policy,
+                          const std::shared_ptr<WriterStats> &stats);
+        Completion truncate(const QString &path, qint64 size);
+        Completion close(const QString &path); // Done with the file for now, e.g. before it gets renamed
+        Completion replace(const QString &path, const QByteArray &contents); // Atomic rewrite, see replaceFileDurably
+        Completion remove(const QString &path);
+        Completion run(std::function<bool()> task); // Anything else, e.g. a compaction, with every file flushed and closed first
+        Completion barrier(); // Done once everything queued before it is
+
+        // Calls then(true if every one of writes made it) on the GUI thread once they're settled, without anyone
+        // waiting for them. Dropped if context is gone by then
+        void whenDone(WriteCompletions writes, QObject *context, std::function<void(bool)> then);
+
+        void shutdown(); // Finishes what's queued and stops, main calls it once the window is gone
+
+        // Summed over every file
+        static quint64 bytesWrittenCount() { return totalBytes.load(); }
+        static quint64 flushCount() { return totalFlushes.load(); }
+        static quint64 syncCount() { return totalSyncs.load(); }
+        static quint64 coalescedCount() { return totalCoalesced.load(); } // Appends that shared a write with an earlier one
+        static quint64 failureCount() { return totalFailures.load(); }
+
+    private:
+        static const int GROUP_COMMIT_WINDOW_US = 500;
+
+        struct Command {
+            enum Type { Append, Truncate, Close, Replace, Remove, Task, Barrier, Notify };
+            Type type = Barrier;
+            QString path;
+            QByteArray data;
+            qint64 size = 0;
+            DurabilityPolicy policy;
+            std::shared_ptr<WriterStats> stats;
+            std::function<bool()> task;
+            std::shared_ptr<std::promise<bool>> done;
+        };
+
+        struct OpenFile; // Defined in iothread.cpp, I/O thread only
+
+        MpscQueue<Command> queue;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        std::atomic<bool> sleeping{false};
+        std::mutex wakeMutex; // Only for parking the thread, the queue itself doesn't lock
+        std::condition_variable wake;
+        std::unordered_map<std::string, std::unique_ptr<OpenFile>> files; // I/O thread only
+
+        static std::atomic<quint64> totalBytes;
+        static std::atomic<quint64> totalFlushes;
+        static std::atomic<quint64> totalSyncs;
+        static std::atomic<quint64> totalCoalesced;
+        static std::atomic<quint64> totalFailures;
+
+        IoThread();
+        Completion submit(Command command);
+
+        // I/O thread only
+        void loop();
+        void execute(Command &command);
+        OpenFile &file(const QString &path);
+        bool flushFile(OpenFile &file);
+        bool flushAll();
+        void closeFile(const QString &path);
+        void closeAll();
+        qint64 msUntilNextDeadline() const; // -1 if nothing is waiting on a timer
+        void flushDue();
+};
+
+#endif // IOTHREAD_H
@@ -4,6 +4,12 @@
 #include <QLocale>
 #include <QTranslator>
 #include <QIcon>
+#include <QDebug>
+#include <QMessageBox>
+#include "recordwriter.h"
+#include "iothread.h"
+#include "datarecovery.h"
+#include "trace.h"
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv); // Our main application
@@ -19,7 +25,60 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    MainWindow w; // Our main window
-    w.show();
-    return a.exec();
+    // How hard the data files are pushed to disk: SARISARI_DURABILITY, overridden by --durability=<policy>
+    // "each" (default), "batch[:records[:ms]]" or "sync", see recordwriter.h
+    QString durability = qEnvironmentVariable("SARISARI_DURABILITY");
+    for (const QString &argument : a.arguments()) {
+        if (argument.startsWith("--durability=")) {
+            durability = argument.mid(int(qstrlen("--durability=")));
+        }
+    }
+    if (!durability.isEmpty()) {
+        bool ok = false;
+        DurabilityPolicy policy = DurabilityPolicy::fromString(durability, &ok);
+        if (ok) {
+            DurabilityPolicy::setDefaultPolicy(policy);
+        } else {
+            qWarning() << "Unknown durability policy" << durability << "- using" << policy.toString();
+        }
+    }
+
+    // Tracing, off unless SARISARI_TRACE=<file> or --trace=<file> says where the trace goes ("1" or a bare
+    // --trace for the default name). Written at exit, and whenever Ctrl+Shift+T is pressed
+    QString tracePath = qEnvironmentVariable("SARISARI_TRACE");
+    for (const QString &argument : a.arguments()) {
+        if (argument == "--trace") {
+            tracePath = "1";
+        } else if (argument.startsWith("--trace=")) {
+            tracePath = argument.mid(int(qstrlen("--trace=")));
+        }
+    }
+    if (!tracePath.isEmpty() && tracePath != "0") {
+        Trace::enable(tracePath == "1" ? "sarisari_trace.json" : tracePath);
+        Trace::setThreadName("GUI thread");
+    }
+
+    // Fix up whatever a crash or power cut left behind before the models read anything
+    const RecoveryReport recovery = recoverDataDirectory("Data");
+
+    int result;
+    {
+        MainWindow w; // Our main window
+        w.show();
+        if (!recovery.isClean()) {
+            QMessageBox::warning(&w, "Data Recovery",
+                                 "The data files needed some repairs after the last session:\n\n" + recovery.actions.join("\n"));
+        }
+        result = a.exec();
+    }
+    IoThread::instance().shutdown(); // Whatever the models still had queued goes out before we exit
+    if (Trace::enabled()) {
+        Trace::writeChromeJson(); // Every other thread is done by now, so nothing comes out torn
+    }
+
+    qInfo() << "Durability" << DurabilityPolicy::defaultPolicy().toString() << "-"
+            << IoThread::bytesWrittenCount() << "bytes written," << IoThread::flushCount() << "flushes,"
+            << IoThread::syncCount() << "fsyncs," << IoThread::coalescedCount() << "appends group committed,"
+            << IoThread::failureCount() << "failures";
+    return result;
 }
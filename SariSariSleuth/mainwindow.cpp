@@ -1,14 +1,21 @@
 #include "mainwindow.h"
+#include "trace.h"
+#include "metrics.h"
 #include "./ui_mainwindow.h"
 #include "itemselectiondialog.h"
+#include "iothread.h"
+#include "datarecovery.h"
+#include "howmuchstyleproxy.h"
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QFileDialog>
 #include <QKeyEvent>
+#include <QCoreApplication>
 #include <algorithm>
 #include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QtConcurrent>
 
 // CONSTRUCTOR
 MainWindow::MainWindow(QWidget *parent)
@@ -19,8 +26,23 @@ MainWindow::MainWindow(QWidget *parent)
     , confirmedTransactionModel(new ConfirmedTransactionModel(this))
     , analyticsModel(new AnalyticsModel(this))
     , howMuchModel(new HowMuchModel(this))
+    , inventoryService(new InventoryService(stockModel, transactionModel, confirmedTransactionModel))
+    , analyticsWatcher(new QFutureWatcher<QVector<ProductAnalytics>>(this))
+    , analyticsPeriod(TimePeriod::LastWeek)
+    , analyticsScheduler(new AnalyticsScheduler(250, this))
+    , analyticsStartedAt(0)
+    , stockLoadWatcher(new QFutureWatcher<StockModel::LoadResult>(this))
+    , pendingLoadWatcher(new QFutureWatcher<TransactionModel::LoadResult>(this))
+    , historyLoadWatcher(new QFutureWatcher<ConfirmedTransactionModel::LoadResult>(this))
+    , stockLoaded(false)
+    , pendingLoaded(false)
+    , historyLoaded(false)
+    , firstAnalyticsDone(false)
+    , diagnosticsPage(new DiagnosticsPage(analyticsScheduler, this))
 {
+    startupTimer.start();
     ui->setupUi(this);
+    qInfo() << "Startup: window set up in" << startupTimer.elapsed() << "ms";
     
     // Set up the main buttons for tabs
     QVector<QPair<QPushButton*, QWidget*>> tabMappings = {
@@ -35,6 +57,8 @@ MainWindow::MainWindow(QWidget *parent)
         });
     }
 
+    ui->stackedWidget->addWidget(diagnosticsPage);
+
     // Set up the table view for stock
     ui->stockTableView->setModel(stockModel);
     ui->stockTableView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
@@ -46,7 +70,7 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Set up the analytics list views
     ui->productsToListView->setModel(analyticsModel);
-    ui->howMuchToListView->setModel(howMuchModel);
+    ui->howMuchToListView->setModel(new HowMuchStyleProxy(howMuchModel, this)); // Bold for whatever ran out, the model itself has no fonts
     
     // Connect signals and slots for stock management
     connect(ui->addButton, &QPushButton::clicked, this, &MainWindow::onAddButtonClicked);
@@ -62,15 +86,27 @@ MainWindow::MainWindow(QWidget *parent)
     // Connect signals and slots for transaction management
     connect(ui->confirmButton, &QPushButton::clicked, this, &MainWindow::onConfirmTransactionClicked);
     connect(ui->deleteTransactionButton, &QPushButton::clicked, this, &MainWindow::onDeleteTransactionClicked);
+    connect(inventoryService, &InventoryService::confirmFinished, this, &MainWindow::onConfirmFinished);
 
     // Connect signals and slots for analytics
     connect(ui->timePeriodComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::onTimePeriodChanged);
     connect(ui->daysToStockSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &MainWindow::onDaysToStockChanged);
+    connect(analyticsWatcher, &QFutureWatcher<QVector<ProductAnalytics>>::finished,
+            this, &MainWindow::onAnalyticsReady);
+
+    // Changes only mark the analytics stale, the scheduler folds a burst of them into one refresh
+    connect(confirmedTransactionModel, &ConfirmedTransactionModel::historyChanged, analyticsScheduler, &AnalyticsScheduler::markDirty);
+    connect(stockModel, &StockModel::stockChanged, analyticsScheduler, &AnalyticsScheduler::markDirty);
+    connect(ui->stackedWidget, &QStackedWidget::currentChanged, this, [this]() {
+        analyticsScheduler->setVisible(ui->stackedWidget->currentWidget() == ui->analyticsTab);
+    });
+    connect(analyticsScheduler, &AnalyticsScheduler::refreshRequested, this, &MainWindow::refreshAnalytics);
+    analyticsScheduler->setVisible(ui->stackedWidget->currentWidget() == ui->analyticsTab);
 
-    // Initialize analytics with current data
-    onTimePeriodChanged(0); // This will load data for LastWeek period
+    // The models start out empty, the first analytics pass runs once the history and stock are in
+    startLoading();
 
     // Icons and Shapes
     struct ButtonStyle {
@@ -103,7 +139,22 @@ MainWindow::MainWindow(QWidget *parent)
 
 // DESTRUCTOR
 MainWindow::~MainWindow() {
+    // A confirm still between its steps gets to finish, or the files would keep half of it
+    while (inventoryService->isConfirming()) {
+        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents | QEventLoop::WaitForMoreEvents);
+    }
+
+    // Don't leave a worker running against models that are about to go away
+    if (analyticsCancelled) {
+        analyticsCancelled->store(true);
+    }
+    analyticsWatcher->waitForFinished();
+    stockLoadWatcher->waitForFinished();
+    pendingLoadWatcher->waitForFinished();
+    historyLoadWatcher->waitForFinished();
+
     delete ui;
+    delete inventoryService;
     delete stockModel;
     delete transactionModel;
     delete confirmedTransactionModel;
@@ -111,8 +162,118 @@ MainWindow::~MainWindow() {
     delete howMuchModel;
 }
 
+void MainWindow::startLoading() {
+    SARI_TRACE_SCOPE("MainWindow::startLoading");
+
+    // Called by the constructor. Each file gets parsed on its own worker, and only the cheap part,
+    // handing the result to the model, happens on the GUI thread
+
+    for (QWidget *tab : {ui->salesTab, ui->transactionsTab, ui->loggingTab, ui->analyticsTab}) {
+        QLabel *label = new QLabel("Loading...", tab); // Not in the tab's layout, it sits on top of it
+        label->setAlignment(Qt::AlignCenter);
+        label->setStyleSheet("background-color: rgba(0, 0, 0, 120); color: white; font-size: 24px;");
+        label->setGeometry(tab->rect());
+        label->raise();
+        tab->installEventFilter(this);
+        loadingLabels.insert(tab, label);
+    }
+    updateLoadingState();
+
+    QDir().mkpath("Data");
+
+    connect(stockLoadWatcher, &QFutureWatcher<StockModel::LoadResult>::finished, this, [this]() {
+        const qint64 ready = startupTimer.elapsed();
+        stockModel->applyLoaded(stockLoadWatcher->result());
+        qInfo() << "Startup: stock ready after" << ready << "ms," << stockModel->rowCount() << "items applied in"
+                << startupTimer.elapsed() - ready << "ms";
+        stockLoaded = true;
+        updateLoadingState();
+    });
+    connect(pendingLoadWatcher, &QFutureWatcher<TransactionModel::LoadResult>::finished, this, [this]() {
+        const qint64 ready = startupTimer.elapsed();
+        transactionModel->applyLoaded(pendingLoadWatcher->result());
+        qInfo() << "Startup: pending transactions ready after" << ready << "ms," << transactionModel->rowCount()
+                << "transactions applied in" << startupTimer.elapsed() - ready << "ms";
+        pendingLoaded = true;
+        updateLoadingState();
+    });
+    connect(historyLoadWatcher, &QFutureWatcher<ConfirmedTransactionModel::LoadResult>::finished, this, [this]() {
+        const qint64 ready = startupTimer.elapsed();
+        confirmedTransactionModel->applyLoaded(historyLoadWatcher->result());
+        qInfo() << "Startup: history ready after" << ready << "ms," << confirmedTransactionModel->historySize()
+                << "transactions applied in" << startupTimer.elapsed() - ready << "ms";
+        historyLoaded = true;
+        updateLoadingState();
+    });
+
+    // The models aren't touched by anything else until their watcher fires
+    StockModel *stock = stockModel;
+    TransactionModel *pending = transactionModel;
+    ConfirmedTransactionModel *history = confirmedTransactionModel;
+    stockLoadWatcher->setFuture(QtConcurrent::run([stock]() { return stock->loadFromDisk(); }));
+    pendingLoadWatcher->setFuture(QtConcurrent::run([pending]() { return pending->loadFromDisk(); }));
+    historyLoadWatcher->setFuture(QtConcurrent::run([history]() { return history->loadFromDisk(); }));
+}
+
+void MainWindow::setChangesEnabled(bool enabled) {
+
+    // Called around a confirm: until it has finished nothing else may change the models, its rollback would undo that too
+
+    const QVector<QPushButton*> buttons = {
+        ui->addButton, ui->editButton, ui->deleteButton, ui->manualAddButton,
+        ui->backupButton, ui->restoreButton, ui->confirmButton, ui->deleteTransactionButton
+    };
+    for (QPushButton *button : buttons) {
+        button->setEnabled(enabled);
+    }
+}
+
+void MainWindow::updateLoadingState() {
+    SARI_TRACE_SCOPE("MainWindow::updateLoadingState");
+
+    // Called by startLoading and whenever one of the loads lands
+
+    const bool everything = stockLoaded && pendingLoaded && historyLoaded;
+    const QHash<QWidget*, bool> ready = {
+        {ui->salesTab, everything}, // Backup and restore live here, they need every file settled
+        {ui->transactionsTab, everything}, // Confirming touches all three
+        {ui->loggingTab, stockLoaded},
+        {ui->analyticsTab, stockLoaded && historyLoaded}
+    };
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+        QLabel *label = loadingLabels.value(it.key());
+        if (!label)
+            continue;
+        if (it.value()) {
+            it.key()->removeEventFilter(this);
+            loadingLabels.remove(it.key());
+            label->deleteLater();
+        }
+        it.key()->setEnabled(it.value()); // No clicking through to a half-loaded model
+    }
+
+    if (stockLoaded && historyLoaded && !firstAnalyticsDone) {
+        firstAnalyticsDone = true;
+        qInfo() << "Startup: first analytics pass requested after" << startupTimer.elapsed() << "ms";
+        analyticsScheduler->refreshNow(); // Whether or not the tab is showing, like it used to on startup
+    }
+    if (everything && loadingLabels.isEmpty()) {
+        qInfo() << "Startup: everything loaded after" << startupTimer.elapsed() << "ms";
+    }
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
+    if (event->type() == QEvent::Resize) {
+        if (QLabel *label = loadingLabels.value(qobject_cast<QWidget*>(watched))) {
+            label->setGeometry(static_cast<QWidget*>(watched)->rect());
+        }
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
 // TAB 3
 void MainWindow::onAddButtonClicked() {
+    SARI_TRACE_SCOPE("MainWindow::onAddButtonClicked");
     bool ok;
     QString productName;
     double price = 0.0;
@@ -217,35 +378,13 @@ void MainWindow::onAddButtonClicked() {
         return;
     }
 
-    // Prepare new StockItem
-    StockItem item;
-    std::vector<int> ids;
-    for (int i = 0; i < this->stockModel->rowCount(); i++) {
-        ids.push_back(this->stockModel->getItem(i).id);
-    }
-
-    int newId = 1;
-    for (int i = 0; i < ids.size(); i++) {
-        if (std::find(ids.begin(), ids.end(), newId) != ids.end()) {
-            newId++;
-        } else {
-            break;
-        }
-    }
-
-    item.id = newId;
-    item.productName = productName;
-    item.price = price;
-    item.stock = stock;
-    item.remaining = stock;
-    item.sold = 0;
-
-    stockModel->addItem(item);
+    inventoryService->addItem(productName, price, stock);
 }
 
 
 void MainWindow::onEditButtonClicked()
 {
+    SARI_TRACE_SCOPE("MainWindow::onEditButtonClicked");
     // Local shared stylesheet
     QString inputDialogStyle = R"(
         QInputDialog {
@@ -329,7 +468,6 @@ void MainWindow::onEditButtonClicked()
 
 
     StockItem item = stockModel->getItem(currentIndex.row());
-    bool ok;
 
     // Product Name
     QInputDialog nameDialog(this);
@@ -368,16 +506,16 @@ void MainWindow::onEditButtonClicked()
     stockDialog.setStyleSheet(inputDialogStyle);
     if (stockDialog.exec() == QDialog::Accepted) {
         item.stock = stockDialog.intValue();
-        item.remaining = item.stock - item.sold;
     } else {
         return;
     }
 
-    stockModel->updateItem(currentIndex.row(), item);
+    inventoryService->editItem(item.id, item.productName, item.price, item.stock);
 }
 
 void MainWindow::onDeleteButtonClicked()
 {
+    SARI_TRACE_SCOPE("MainWindow::onDeleteButtonClicked");
     QModelIndex currentIndex = ui->stockTableView->currentIndex();
     if (!currentIndex.isValid()) {
         QMessageBox warningBox(this);
@@ -451,11 +589,13 @@ void MainWindow::onDeleteButtonClicked()
 }
 
 void MainWindow::onFilterTextChanged(const QString &text) {
+    SARI_TRACE_SCOPE("MainWindow::onFilterTextChanged");
     stockModel->filterItems(text);
 }
 
 // TAB 1
 void MainWindow::onManualAddClicked() {
+    SARI_TRACE_SCOPE("MainWindow::onManualAddClicked");
     ItemSelectionDialog dialog(stockModel, this);
     if (dialog.exec() == QDialog::Accepted) {
         StockItem selectedItem = dialog.getSelectedItem();
@@ -467,6 +607,9 @@ void MainWindow::onManualAddClicked() {
 }
 
 void MainWindow::onBackupButtonClicked() {
+    SARI_TRACE_SCOPE("MainWindow::onBackupButtonClicked");
+    IoThread::instance().barrier().wait(); // Copy the files only after every queued write reached them
+
     // Create backup directory with timestamp
     QDateTime currentDateTime = QDateTime::currentDateTime();
     QString timestamp = currentDateTime.toString("yyyy-MM-dd_hh-mm-ss");
@@ -506,6 +649,7 @@ void MainWindow::onBackupButtonClicked() {
 }
 
 void MainWindow::onRestoreButtonClicked() {
+    SARI_TRACE_SCOPE("MainWindow::onRestoreButtonClicked");
     // Prompt user to select a backup directory
     QString backupDir = QFileDialog::getExistingDirectory(this, "Select Backup Directory", "Backup",
         QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
@@ -562,13 +706,12 @@ void MainWindow::onRestoreButtonClicked() {
     }
     
     if (success) {
+        recoverDataDirectory("Data"); // The backup may have been taken from a crashed session
+
         // Reload models with new data
         stockModel->readDataFromFile();
         transactionModel->readDataFromFile();
-        confirmedTransactionModel->readDataFromFile();
-        
-        // Update analytics
-        onTimePeriodChanged(ui->timePeriodComboBox->currentIndex());
+        confirmedTransactionModel->readDataFromFile(); // historyChanged marks the analytics stale
         
         QMessageBox::information(this, "Restore Complete", "Data has been successfully restored from: " + backupDir);
     } else {
@@ -579,54 +722,59 @@ void MainWindow::onRestoreButtonClicked() {
 // TAB 2
 void MainWindow::onConfirmTransactionClicked()
 {
-    QModelIndex currentIndex = ui->transactionTableView->currentIndex();
-    if (!currentIndex.isValid()) {
+    SARI_TRACE_SCOPE("MainWindow::onConfirmTransactionClicked");
+    // Everything selected gets confirmed in one go (Ctrl+A for all of them)
+    QModelIndexList selected = ui->transactionTableView->selectionModel()->selectedRows();
+    if (selected.isEmpty()) {
         QMessageBox::warning(this, "Confirm", "Please select a transaction to confirm.");
         return;
     }
+    QVector<int> rows;
+    for (const QModelIndex &index : selected) {
+        rows.append(index.row());
+    }
+
+    // The stock and history bookkeeping lives in InventoryService, only the question is asked here.
+    // The writes finish on the I/O thread, onConfirmFinished takes it from there
+    setChangesEnabled(false);
+    inventoryService->confirmPending(rows, [this, &rows](const StockItem &item, int quantity) {
+        return QMessageBox::warning(this, "Low Stock Warning",
+            QString("This transaction would reduce stock below zero.\n"
+                "Current remaining stock: %1\n"
+                "Transaction quantity: %2\n\n"
+                "Would you like to continue? The remaining stock will be set to 0.").arg(item.remaining).arg(quantity)
+                + (rows.size() > 1 ? "\n\nThe answer applies to every item in the selection that runs out." : ""),
+            QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
+    });
+}
 
-    Transaction transaction = transactionModel->getTransaction(currentIndex.row());
-
-    // Update stock
-    StockItem item;
-    for (int i = 0; i < stockModel->rowCount(); i++) {
-        if (transaction.item.id == stockModel->getItem(i).id) {
-            item = stockModel->getItem(i);
-            if (item.remaining < transaction.quantity) {
-                QMessageBox::StandardButton reply = QMessageBox::warning(this, "Low Stock Warning",
-                    QString("This transaction would reduce stock below zero.\n"
-                        "Current remaining stock: %1\n"
-                        "Transaction quantity: %2\n\n"
-                        "Would you like to continue? The remaining stock will be set to 0.").arg(item.remaining).arg(transaction.quantity),
-                QMessageBox::Yes | QMessageBox::No);
-                if (reply == QMessageBox::No) {
-                    break;
-                }
-                item.sold += item.remaining;
-                confirmedTransactionModel->addTransaction(transaction.item, item.remaining);
-                item.remaining = 0;
-                stockModel->updateItem(i, item);
-                break;
-            } else {
-                item.remaining -= transaction.quantity;
-                item.sold += transaction.quantity;
-                confirmedTransactionModel->addTransaction(transaction.item, transaction.quantity);
-                stockModel->updateItem(i, item);
-                break;
-            }
-        }
-    }
-
-    // Remove from pending transactions
-    transactionModel->removeTransaction(currentIndex.row());
+void MainWindow::onConfirmFinished(const InventoryService::ConfirmResult &result)
+{
+    SARI_TRACE_SCOPE("MainWindow::onConfirmFinished");
+    setChangesEnabled(true);
 
-    // Update analytics with current time period
-    int currentPeriodIndex = ui->timePeriodComboBox->currentIndex();
-    onTimePeriodChanged(currentPeriodIndex);
+    switch (result.status) {
+        case InventoryService::ConfirmStatus::Confirmed:
+            break;
+        case InventoryService::ConfirmStatus::HistoryFailed:
+            QMessageBox::critical(this, "Confirm", "Failed to save the transaction history, nothing was confirmed.");
+            break;
+        case InventoryService::ConfirmStatus::StockFailed:
+            QMessageBox::critical(this, "Confirm", "Failed to save the stock, nothing was confirmed.");
+            break;
+        case InventoryService::ConfirmStatus::PendingFailed:
+            QMessageBox::critical(this, "Confirm", "Failed to update the pending transactions, nothing was confirmed.");
+            break;
+        case InventoryService::ConfirmStatus::RollbackFailed:
+            QMessageBox::critical(this, "Confirm", "Failed to save the sale, and undoing the part that was saved failed too.\n"
+                "The stock, pending and history files may not agree. Restart the app, or restore a backup.");
+            break;
+    }
 }
 
 void MainWindow::onDeleteTransactionClicked()
 {
+    SARI_TRACE_SCOPE("MainWindow::onDeleteTransactionClicked");
     QModelIndex currentIndex = ui->transactionTableView->currentIndex();
     if (!currentIndex.isValid()) {
         QMessageBox::warning(this, "Delete", "Please select a transaction to delete.");
@@ -642,69 +790,75 @@ void MainWindow::onDeleteTransactionClicked()
 // TAB 4
 void MainWindow::onTimePeriodChanged(int index)
 {
+    SARI_TRACE_SCOPE("MainWindow::onTimePeriodChanged");
+    Q_UNUSED(index); // refreshAnalytics reads the combo box itself
+    analyticsScheduler->refreshNow();
+}
+
+void MainWindow::refreshAnalytics() {
+    SARI_TRACE_SCOPE("MainWindow::refreshAnalytics");
+
+    // Called by the analytics scheduler
+
     TimePeriod period;
-    switch (index) {
+    switch (ui->timePeriodComboBox->currentIndex()) {
         case 0: period = TimePeriod::LastWeek; break;
         case 1: period = TimePeriod::LastMonth; break;
         case 2: period = TimePeriod::LastYear; break;
         default: period = TimePeriod::LastWeek;
     }
-    
-    // Get all transactions from confirmedTransactionModel
-    QVector<ConfirmedTransaction> transactions;
-    for (int i = 0; i < confirmedTransactionModel->rowCount(); ++i) {
-        transactions.append(confirmedTransactionModel->getTransaction(i));
+
+    // Whatever is still running is stale now, tell it to stop early
+    if (analyticsCancelled) {
+        analyticsCancelled->store(true);
     }
-    
-    analyticsModel->updateAnalytics(transactions, period);
-    
-    // Update the how much to stock list
-    QVector<ProductAnalytics> analytics;
-    for (int i = 0; i < analyticsModel->rowCount(); ++i) {
-        QModelIndex idx = analyticsModel->index(i);
-        QString text = analyticsModel->data(idx).toString();
-        QStringList parts = text.split(" - Sold: ");
-        QString name = parts[0];
-        QStringList soldParts = parts[1].split(" (Rate: ");
-        int sold = soldParts[0].toInt();
-        QString rateStr = soldParts[1].split("/day")[0];
-        double rate = rateStr.toDouble();
-        
-        ProductAnalytics analytic;
-        analytic.productName = name;
-        analytic.totalSold = sold;
-        analytic.salesRate = rate;
-        analytics.append(analytic);
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    analyticsCancelled = cancelled;
+    analyticsPeriod = period;
+    analyticsStartedAt = Metrics::now();
+
+    // Copying the rollup is cheap (implicitly shared), and the worker gets a snapshot
+    // that new sales on the GUI thread won't change under it
+    const SalesRollup snapshot = confirmedTransactionModel->salesRollup();
+    const QDateTime now = QDateTime::currentDateTime();
+
+    // setFuture drops the previous future, so a stale run never reaches onAnalyticsReady
+    analyticsWatcher->setFuture(QtConcurrent::run([snapshot, period, now, cancelled]() {
+        return AnalyticsModel::calculateAnalytics(snapshot, period, now, cancelled.get());
+    }));
+}
+
+void MainWindow::onAnalyticsReady() {
+    SARI_TRACE_SCOPE("MainWindow::onAnalyticsReady");
+    if (analyticsCancelled->load()) {
+        return;
     }
-    
-    howMuchModel->updateRecommendations(analytics, ui->daysToStockSpinBox->value(), stockModel);
+
+    Metrics::analyticsRefresh.record(Metrics::now() - analyticsStartedAt); // Worker and all, what the cashier waited for
+
+    // One reset for the whole result, then the cheap join against stock
+    analyticsModel->setAnalytics(analyticsWatcher->result(), analyticsPeriod);
+    howMuchModel->updateRecommendations(analyticsModel->getAnalytics(), ui->daysToStockSpinBox->value(), stockModel);
 }
 
 void MainWindow::onDaysToStockChanged(int days)
 {
-    // Get current analytics data
-    QVector<ProductAnalytics> analytics;
-    for (int i = 0; i < analyticsModel->rowCount(); ++i) {
-        QModelIndex idx = analyticsModel->index(i);
-        QString text = analyticsModel->data(idx).toString();
-        QStringList parts = text.split(" - Sold: ");
-        QString name = parts[0];
-        QStringList soldParts = parts[1].split(" (Rate: ");
-        int sold = soldParts[0].toInt();
-        QString rateStr = soldParts[1].split("/day")[0];
-        double rate = rateStr.toDouble();
-        
-        ProductAnalytics analytic;
-        analytic.productName = name;
-        analytic.totalSold = sold;
-        analytic.salesRate = rate;
-        analytics.append(analytic);
+    SARI_TRACE_SCOPE("MainWindow::onDaysToStockChanged");
+    // A run still in flight will pick up the new value from the spin box when it lands
+    if (analyticsWatcher->isRunning()) {
+        return;
     }
-    
-    howMuchModel->updateRecommendations(analytics, days, stockModel);
+
+    // Straight from the analytics model, no display strings involved
+    howMuchModel->updateRecommendations(analyticsModel->getAnalytics(), days, stockModel);
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_T && event->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier) && Trace::enabled()) {
+        Trace::writeChromeJson(); // What's in the rings so far, e.g. right after something lagged
+        return;
+    }
+
     switch (event->key()) {
         case Qt::Key_1:
             ui->stackedWidget->setCurrentWidget(ui->salesTab);
@@ -718,6 +872,9 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
         case Qt::Key_4:
             ui->stackedWidget->setCurrentWidget(ui->analyticsTab);
             break;
+        case Qt::Key_5:
+            ui->stackedWidget->setCurrentWidget(diagnosticsPage);
+            break;
         default:
             QMainWindow::keyPressEvent(event);
     }
@@ -2,11 +2,20 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLabel>
+#include <atomic>
+#include <memory>
 #include "stockmodel.h"
 #include "transactionmodel.h"
 #include "confirmedtransactionmodel.h"
 #include "analyticsmodel.h"
 #include "howmuchmodel.h"
+#include "analyticsscheduler.h"
+#include "inventoryservice.h"
+#include "diagnosticspage.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -28,14 +37,17 @@ class MainWindow : public QMainWindow {
         void onFilterTextChanged(const QString &text);
         void onManualAddClicked();
         void onConfirmTransactionClicked();
+        void onConfirmFinished(const InventoryService::ConfirmResult &result);
         void onDeleteTransactionClicked();
         void onTimePeriodChanged(int index);
         void onDaysToStockChanged(int days);
+        void onAnalyticsReady();
         void onBackupButtonClicked();
         void onRestoreButtonClicked();
 
     protected:
         void keyPressEvent(QKeyEvent *event) override;
+        bool eventFilter(QObject *watched, QEvent *event) override; // Keeps the loading labels covering their tabs
 
     private:
         Ui::MainWindow *ui;
@@ -44,6 +56,32 @@ class MainWindow : public QMainWindow {
         ConfirmedTransactionModel *confirmedTransactionModel;
         AnalyticsModel *analyticsModel;
         HowMuchModel *howMuchModel;
+        InventoryService *inventoryService; // Confirming sales and editing stock, on top of the models above
+        void setChangesEnabled(bool enabled); // Every button that changes a model, off while a confirm is running
+
+        // Analytics are computed off the GUI thread, only the newest run gets shown
+        QFutureWatcher<QVector<ProductAnalytics>> *analyticsWatcher;
+        std::shared_ptr<std::atomic<bool>> analyticsCancelled;
+        TimePeriod analyticsPeriod;
+        AnalyticsScheduler *analyticsScheduler; // Decides when refreshAnalytics actually runs
+        qint64 analyticsStartedAt; // Metrics::now() when the newest run was started
+        void refreshAnalytics();
+
+        // The data files load on workers, one each, while the window is already up. A tab stays in
+        // its loading state until every model it needs is in
+        QElapsedTimer startupTimer;
+        QFutureWatcher<StockModel::LoadResult> *stockLoadWatcher;
+        QFutureWatcher<TransactionModel::LoadResult> *pendingLoadWatcher;
+        QFutureWatcher<ConfirmedTransactionModel::LoadResult> *historyLoadWatcher;
+        bool stockLoaded;
+        bool pendingLoaded;
+        bool historyLoaded;
+        bool firstAnalyticsDone;
+        QHash<QWidget*, QLabel*> loadingLabels; // Tab -> its "Loading..." cover
+        void startLoading();
+        void updateLoadingState();
+
+        DiagnosticsPage *diagnosticsPage; // Not one of the tab buttons, only key 5 gets there
 };
 
 #endif
@@ -0,0 +1,103 @@
+#include "metrics.h"
+#include <QtAlgorithms>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace Metrics {
+
+namespace {
+const std::chrono::steady_clock::time_point launched = std::chrono::steady_clock::now();
+}
+
+LatencyHistogram saleConfirm("Sale confirm");
+LatencyHistogram stockEdit("Stock edit");
+LatencyHistogram filterKeystroke("Filter keystroke");
+LatencyHistogram analyticsRefresh("Analytics refresh");
+LatencyHistogram fileRewrite("File rewrite");
+LatencyHistogram fileRewriteSize("File rewrite size", "B");
+LatencyHistogram loadStock("Load stock");
+LatencyHistogram loadPending("Load pending");
+LatencyHistogram loadHistory("Load history");
+Counter fileRewriteBytes("File rewrite bytes");
+Counter recordsAppended("Appends queued");
+
+const QVector<LatencyHistogram*> &histograms() {
+    static const QVector<LatencyHistogram*> all = {&saleConfirm, &stockEdit, &filterKeystroke, &analyticsRefresh, &fileRewrite,
+                                                   &fileRewriteSize, &loadStock, &loadPending, &loadHistory};
+    return all;
+}
+
+const QVector<Counter*> &counters() {
+    static const QVector<Counter*> all = {&fileRewriteBytes, &recordsAppended};
+    return all;
+}
+
+qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - launched).count();
+}
+
+double uptimeSeconds() {
+    return now() / 1e9;
+}
+
+// CONSTRUCTOR
+LatencyHistogram::LatencyHistogram(const char *name, const char *unit) : label(name), units(unit) {
+    for (std::atomic<quint64> &bucket : counts) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketOf(qint64 value) {
+    if (value < SUB_BUCKETS)
+        return int(std::max<qint64>(value, 0));
+    const int magnitude = 63 - int(qCountLeadingZeroBits(quint64(value))); // Highest set bit, >= SUB_BUCKET_BITS here
+    const int shift = magnitude - SUB_BUCKET_BITS;
+    const int top = int(quint64(value) >> shift); // SUB_BUCKETS..2 * SUB_BUCKETS - 1
+    return SUB_BUCKETS + shift * SUB_BUCKETS + (top - SUB_BUCKETS);
+}
+
+qint64 LatencyHistogram::bucketTop(int bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    const int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    const quint64 top = quint64(SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS);
+    return qint64(std::min<quint64>(((top + 1) << shift) - 1, quint64(std::numeric_limits<qint64>::max())));
+}
+
+void LatencyHistogram::record(qint64 value) {
+    value = std::max<qint64>(value, 0);
+    counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(quint64(value), std::memory_order_relaxed);
+    qint64 seen = largest.load(std::memory_order_relaxed);
+    while (value > seen && !largest.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.buckets.resize(BUCKETS);
+    for (int i = 0; i < BUCKETS; i++) {
+        snapshot.buckets[i] = counts[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i]; // From the buckets, so the percentiles always add up
+    }
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    snapshot.max = largest.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+qint64 LatencyHistogram::Snapshot::percentile(double p) const {
+    if (count == 0)
+        return 0;
+    const quint64 rank = std::max<quint64>(1, quint64(std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * count)));
+    quint64 seen = 0;
+    for (int i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min(bucketTop(i), max); // Nothing recorded went past max
+    }
+    return max;
+}
+
+} // namespace Metrics
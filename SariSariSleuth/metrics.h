@@ -0,0 +1,95 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Always-on counters and latency histograms for the operations the cashier waits on, shown on the
+// diagnostics page (key 5). Recording is a couple of relaxed atomic adds, no locks, so it can sit on
+// any thread and in the middle of a confirm.
+namespace Metrics {
+
+    // HDR style: exact below 32 ns, above that 32 buckets per power of two, so any percentile is off by
+    // at most about 3%. Covers everything a qint64 of nanoseconds can hold, in about 15 KB
+    class LatencyHistogram {
+        public:
+            static const int SUB_BUCKET_BITS = 5;
+            static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+            static const int BUCKETS = SUB_BUCKETS * (64 - SUB_BUCKET_BITS + 1);
+
+            struct Snapshot {
+                quint64 count = 0;
+                quint64 sum = 0; // Nanoseconds, or whatever unit was recorded
+                qint64 max = 0;
+                QVector<quint64> buckets;
+
+                qint64 percentile(double p) const; // p in [0, 100], the top of the bucket it falls in
+                double mean() const { return count ? double(sum) / count : 0.0; }
+            };
+
+            explicit LatencyHistogram(const char *name, const char *unit = "ns");
+
+            void record(qint64 value);
+            Snapshot snapshot() const; // Not atomic across buckets, fine for a display
+
+            const char *name() const { return label; }
+            const char *unit() const { return units; }
+
+            static int bucketOf(qint64 value);
+            static qint64 bucketTop(int bucket); // Largest value that lands in bucket
+
+        private:
+            const char *label;
+            const char *units;
+            std::atomic<quint64> counts[BUCKETS];
+            std::atomic<quint64> sum{0};
+            std::atomic<qint64> largest{0};
+    };
+
+    struct Counter {
+        const char *name;
+        std::atomic<quint64> value{0};
+        explicit Counter(const char *name) : name(name) {}
+        void add(quint64 amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    };
+
+    // The operations that matter, in the order the diagnostics page lists them
+    extern LatencyHistogram saleConfirm;
+    extern LatencyHistogram stockEdit;
+    extern LatencyHistogram filterKeystroke;
+    extern LatencyHistogram analyticsRefresh;
+    extern LatencyHistogram fileRewrite;
+    extern LatencyHistogram fileRewriteSize; // Bytes, not time
+    extern LatencyHistogram loadStock;
+    extern LatencyHistogram loadPending;
+    extern LatencyHistogram loadHistory;
+    extern Counter fileRewriteBytes;
+    extern Counter recordsAppended;
+
+    const QVector<LatencyHistogram*> &histograms();
+    const QVector<Counter*> &counters();
+
+    qint64 now(); // Nanoseconds since launch, steady
+    double uptimeSeconds();
+
+    // Records the time from construction to destruction, unless cancel() was called
+    class ScopedTimer {
+        private:
+            LatencyHistogram &histogram;
+            qint64 start;
+
+        public:
+            explicit ScopedTimer(LatencyHistogram &histogram) : histogram(histogram), start(now()) {}
+            ~ScopedTimer() {
+                if (start >= 0)
+                    histogram.record(now() - start);
+            }
+            void cancel() { start = -1; }
+            void exclude(qint64 ns) { start += ns; } // Time spent waiting on the user doesn't count
+            ScopedTimer(const ScopedTimer &) = delete;
+            ScopedTimer &operator=(const ScopedTimer &) = delete;
+    };
+}
+
+#endif // METRICS_H
@@ -0,0 +1,68 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+// Unbounded multi-producer, single-consumer queue (Dmitry Vyukov's node based one).
+// push never blocks or locks, it's one atomic exchange plus one store. Only one thread may pop.
+template <typename T>
+class MpscQueue {
+    private:
+        struct Node {
+            std::atomic<Node *> next{nullptr};
+            T value;
+        };
+
+        std::atomic<Node *> head; // Last node pushed, producers swap themselves in here
+        Node *tail; // Consumer side, always a node whose value was already taken (or the initial stub)
+
+    public:
+        MpscQueue() {
+            Node *stub = new Node();
+            head.store(stub);
+            tail = stub;
+        }
+
+        ~MpscQueue() {
+            T discarded;
+            while (pop(discarded)) {
+            }
+            delete tail;
+        }
+
+        MpscQueue(const MpscQueue &) = delete;
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        void push(T value) {
+            Node *node = new Node();
+            node->value = std::move(value);
+            Node *previous = head.exchange(node, std::memory_order_seq_cst); // seq_cst pairs with the sleeping check in IoThread
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        bool pop(T &value) {
+            Node *next = tail->next.load(std::memory_order_acquire);
+            if (!next) {
+                if (head.load(std::memory_order_seq_cst) == tail)
+                    return false; // Really empty
+                // A producer swapped itself in but hasn't linked the node yet, it's a couple of instructions away
+                do {
+                    std::this_thread::yield();
+                    next = tail->next.load(std::memory_order_acquire);
+                } while (!next);
+            }
+            value = std::move(next->value);
+            next->value = T(); // Let go of whatever the value holds now, next stays around as the new stub
+            delete tail;
+            tail = next;
+            return true;
+        }
+
+        bool empty() const { // Consumer only
+            return head.load(std::memory_order_seq_cst) == tail;
+        }
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,40 @@
+#include "namedictionary.h"
+
+qint32 NameDictionary::find(const QString &name) const {
+    return ids.value(name, -1);
+}
+
+qint32 NameDictionary::intern(const QString &name) {
+    auto it = ids.constFind(name);
+    if (it != ids.constEnd())
+        return it.value();
+    return add(name);
+}
+
+qint32 NameDictionary::add(const QString &name) {
+    const qint32 id = names.size();
+    names.append(name);
+    if (!ids.contains(name)) { // A duplicate line keeps pointing lookups at the first one
+        ids.insert(name, id);
+    }
+    return id;
+}
+
+const QString &NameDictionary::name(qint32 id) const {
+    static const QString unknown;
+    return id >= 0 && id < names.size() ? names[id] : unknown;
+}
+
+void NameDictionary::truncate(int size) {
+    while (names.size() > size) {
+        auto it = ids.find(names.takeLast());
+        if (it != ids.end() && it.value() >= names.size()) { // Not if it points at an earlier duplicate
+            ids.erase(it);
+        }
+    }
+}
+
+void NameDictionary::clear() {
+    names.clear();
+    ids.clear();
+}
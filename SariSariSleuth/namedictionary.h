@@ -0,0 +1,26 @@
+#ifndef NAMEDICTIONARY_H
+#define NAMEDICTIONARY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Interned product names: every distinct name is kept once and referred to by a small id,
+// so a history row carries a qint32 instead of its own QString.
+// The ids are the line numbers in the history's names file, see BinaryHistory.
+class NameDictionary {
+    private:
+        QVector<QString> names; // Index = id
+        QHash<QString, qint32> ids;
+
+    public:
+        qint32 find(const QString &name) const; // -1 if it isn't in yet
+        qint32 intern(const QString &name); // The existing id, or a new one
+        qint32 add(const QString &name); // Always a new id, for loading a names file line by line
+        const QString &name(qint32 id) const; // Empty for an id it doesn't have
+        int size() const { return names.size(); }
+        void truncate(int size); // Forgets every id from size on, e.g. names whose line never made it to the file
+        void clear();
+};
+
+#endif // NAMEDICTIONARY_H
@@ -0,0 +1,157 @@
+#include "recordframe.h"
+#include <QtEndian>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define SARISARI_X86_CRC32C
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define SARISARI_X86_CRC32C
+#endif
+
+namespace {
+
+const quint32 POLYNOMIAL = 0x82F63B78; // Castagnoli, reversed
+
+// tables[0] is the usual byte at a time table, tables[k] advances a byte k positions further
+struct SliceTables {
+    quint32 tables[8][256];
+
+    SliceTables() {
+        for (quint32 byte = 0; byte < 256; byte++) {
+            quint32 crc = byte;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+            }
+            tables[0][byte] = crc;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int byte = 0; byte < 256; byte++) {
+                const quint32 previous = tables[k - 1][byte];
+                tables[k][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+            }
+        }
+    }
+};
+
+quint32 crc32cSoftware(quint32 crc, const uchar *data, size_t size) {
+    static const SliceTables slices;
+    const quint32 (*t)[256] = slices.tables;
+
+    while (size >= 8) {
+        quint32 low, high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        low = qFromLittleEndian(low);
+        high = qFromLittleEndian(high);
+#endif
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef SARISARI_X86_CRC32C
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+quint32 crc32cHardware(quint32 crc, const uchar *data, size_t size) {
+#if defined(__x86_64__) || defined(_M_X64)
+    quint64 wide = crc;
+    while (size >= 8) {
+        quint64 value;
+        std::memcpy(&value, data, 8);
+        wide = _mm_crc32_u64(wide, value);
+        data += 8;
+        size -= 8;
+    }
+    crc = quint32(wide);
+#endif
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+bool cpuHasCrc32c() {
+#if defined(__GNUC__) || defined(__clang__)
+    static const bool has = __builtin_cpu_supports("sse4.2");
+#else
+    static const bool has = [] {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+    }();
+#endif
+    return has;
+}
+
+#endif
+
+} // namespace
+
+quint32 crc32c(const char *data, size_t size, quint32 crc) {
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    crc = ~crc;
+#ifdef SARISARI_X86_CRC32C
+    if (cpuHasCrc32c())
+        return ~crc32cHardware(crc, bytes, size);
+#endif
+    return ~crc32cSoftware(crc, bytes, size);
+}
+
+std::string frameRecord(std::string_view payload) {
+    char prefix[32];
+    const int prefixSize = std::snprintf(prefix, sizeof(prefix), "~%zu:%08x|", payload.size(),
+                                         unsigned(crc32c(payload.data(), payload.size())));
+
+    std::string line;
+    line.reserve(size_t(prefixSize) + payload.size() + 1);
+    line.append(prefix, size_t(prefixSize));
+    line.append(payload);
+    line.push_back('\n');
+    return line;
+}
+
+FrameStatus unframeRecord(std::string_view line, std::string_view &payload) {
+    if (line.find('\0') != std::string_view::npos) // Zero filled blocks are what a lost write looks like on most filesystems
+        return FrameStatus::Corrupt;
+
+    if (line.empty() || line.front() != '~') {
+        payload = line;
+        return FrameStatus::Legacy;
+    }
+
+    const char *end = line.data() + line.size();
+    size_t length = 0;
+    auto [afterLength, lengthError] = std::from_chars(line.data() + 1, end, length);
+    if (lengthError != std::errc() || afterLength == end || *afterLength != ':')
+        return FrameStatus::Corrupt;
+
+    const char *crcStart = afterLength + 1;
+    if (end - crcStart < 9 || crcStart[8] != '|')
+        return FrameStatus::Corrupt;
+    quint32 expected = 0;
+    auto [afterCrc, crcError] = std::from_chars(crcStart, crcStart + 8, expected, 16);
+    if (crcError != std::errc() || afterCrc != crcStart + 8)
+        return FrameStatus::Corrupt;
+
+    std::string_view framed(crcStart + 9, size_t(end - (crcStart + 9)));
+    if (framed.size() != length || crc32c(framed.data(), framed.size()) != expected)
+        return FrameStatus::Corrupt;
+
+    payload = framed;
+    return FrameStatus::Valid;
+}
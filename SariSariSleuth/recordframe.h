@@ -0,0 +1,26 @@
+#ifndef RECORDFRAME_H
+#define RECORDFRAME_H
+
+#include <QtGlobal>
+#include <string>
+#include <string_view>
+
+// Every line the app writes to Data/ is framed as "~<payload length>:<crc32c, 8 hex digits>|<payload>"
+// so a torn or garbled record can be told apart from a good one without parsing it.
+// Lines without the '~' are from before the framing and are taken as they are.
+
+// CRC32C (Castagnoli). Uses the SSE 4.2 crc32 instruction when the CPU has it, slicing-by-8 otherwise
+quint32 crc32c(const char *data, size_t size, quint32 crc = 0);
+
+std::string frameRecord(std::string_view payload); // One framed line, newline included
+
+enum class FrameStatus {
+    Valid, // Framed and the checksum matches
+    Legacy, // Written before the framing, can't be checked
+    Corrupt // Bad frame, wrong length or checksum, or NUL bytes (what a power cut tends to leave behind)
+};
+
+// line is one line without its newline. payload is set for Valid and Legacy
+FrameStatus unframeRecord(std::string_view line, std::string_view &payload);
+
+#endif // RECORDFRAME_H
@@ -0,0 +1,155 @@
+#include "recordparser.h"
+#include "recordframe.h"
+#include <QDebug>
+#include <QFile>
+#include <charconv>
+#include <cstdlib>
+
+RecordParser::RecordParser(std::string_view line) : rest(line), exhausted(false) {
+}
+
+bool RecordParser::next(std::string_view &field) {
+    if (exhausted)
+        return false;
+
+    size_t bar = rest.find('|');
+    if (bar == std::string_view::npos) { // Last field
+        field = rest;
+        rest = std::string_view();
+        exhausted = true;
+    } else {
+        field = rest.substr(0, bar);
+        rest.remove_prefix(bar + 1);
+    }
+    return true;
+}
+
+bool RecordParser::nextInt(int &value) {
+    std::string_view field;
+    if (!next(field))
+        return false;
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+bool RecordParser::nextInt64(qint64 &value) {
+    std::string_view field;
+    if (!next(field))
+        return false;
+    long long parsed = 0;
+    auto result = std::from_chars(field.data(), field.data() + field.size(), parsed);
+    value = parsed;
+    return result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+bool RecordParser::nextDouble(double &value) {
+    std::string_view field;
+    if (!next(field) || field.empty())
+        return false;
+#if defined(__cpp_lib_to_chars)
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc() && result.ptr == field.data() + field.size();
+#else
+    // Standard libraries without floating point from_chars, strtod needs a terminated copy
+    char buffer[64];
+    if (field.size() >= sizeof(buffer))
+        return false;
+    field.copy(buffer, field.size());
+    buffer[field.size()] = '\0';
+    char *end = nullptr;
+    value = std::strtod(buffer, &end);
+    return end == buffer + field.size();
+#endif
+}
+
+bool RecordParser::nextString(QString &value) {
+    std::string_view field;
+    if (!next(field))
+        return false;
+    value = QString::fromUtf8(field.data(), int(field.size()));
+    return true;
+}
+
+bool RecordParser::nextTimestamp(QDateTime &value) {
+    std::string_view field;
+    return next(field) && parseTimestamp(field, value);
+}
+
+bool parseTimestamp(std::string_view text, QDateTime &value) {
+    // yyyy-MM-dd hh:mm:ss
+    // 0123456789012345678
+    if (text.size() != 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' || text[13] != ':' || text[16] != ':')
+        return false;
+
+    auto digits = [&text](size_t from, size_t count, int &out) {
+        out = 0;
+        for (size_t i = from; i < from + count; i++) {
+            if (text[i] < '0' || text[i] > '9')
+                return false;
+            out = out * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+
+    int year, month, day, hour, minute, second;
+    if (!digits(0, 4, year) || !digits(5, 2, month) || !digits(8, 2, day)
+        || !digits(11, 2, hour) || !digits(14, 2, minute) || !digits(17, 2, second))
+        return false;
+
+    QDate date(year, month, day);
+    QTime time(hour, minute, second);
+    if (!date.isValid() || !time.isValid())
+        return false;
+
+    value = QDateTime(date, time); // Local time, same as QDateTime::fromString
+    return true;
+}
+
+int forEachRecord(const QString &path, const std::function<bool(RecordParser &fields, std::string_view line)> &parseLine) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    // Map the file if we can, otherwise read it into one buffer
+    QByteArray buffer;
+    const char *data = nullptr;
+    qint64 size = file.size();
+    if (size > 0) {
+        data = reinterpret_cast<const char *>(file.map(0, size));
+        if (!data) {
+            buffer = file.readAll();
+            data = buffer.constData();
+            size = buffer.size();
+        }
+    }
+
+    int malformed = 0;
+    int lineNumber = 0;
+    std::string_view contents(data, size_t(size));
+    while (!contents.empty()) {
+        lineNumber++;
+        size_t newline = contents.find('\n');
+        std::string_view line = contents.substr(0, newline);
+        contents.remove_prefix(newline == std::string_view::npos ? contents.size() : newline + 1);
+
+        if (!line.empty() && line.back() == '\r') // Written in text mode on Windows
+            line.remove_suffix(1);
+        if (line.empty())
+            continue;
+
+        std::string_view payload;
+        if (unframeRecord(line, payload) == FrameStatus::Corrupt) {
+            qWarning().noquote() << path << "line" << lineNumber << "fails its checksum, skipping it";
+            malformed++;
+            continue;
+        }
+        line = payload;
+
+        RecordParser fields(line);
+        if (!parseLine(fields, line)) {
+            qWarning().noquote() << path << "line" << lineNumber << "is malformed, skipping it:" << QString::fromUtf8(line.data(), int(line.size()));
+            malformed++;
+        }
+    }
+    return malformed;
+}
@@ -0,0 +1,38 @@
+#ifndef RECORDPARSER_H
+#define RECORDPARSER_H
+
+#include <QDateTime>
+#include <QString>
+#include <string_view>
+#include <functional>
+
+// Splits one '|' separated record into its fields without allocating.
+// Numbers go through std::from_chars, so a bad field just makes next*() return false
+// instead of throwing like std::stoi does.
+class RecordParser {
+    private:
+        std::string_view rest; // What's left of the line
+        bool exhausted;
+
+    public:
+        explicit RecordParser(std::string_view line);
+
+        bool next(std::string_view &field); // Raw field, no conversion
+        bool nextInt(int &value);
+        bool nextInt64(qint64 &value);
+        bool nextDouble(double &value);
+        bool nextString(QString &value); // The QString is the only allocation
+        bool nextTimestamp(QDateTime &value); // "yyyy-MM-dd hh:mm:ss"
+        bool atEnd() const { return exhausted; }
+};
+
+// Fixed layout parser for "yyyy-MM-dd hh:mm:ss", way cheaper than QDateTime::fromString with a format
+bool parseTimestamp(std::string_view text, QDateTime &value);
+
+// Reads the whole file in one go and hands every non-empty line to parseLine, with its frame
+// (see recordframe.h) already checked and stripped. Lines that fail their checksum or that parseLine
+// rejects are reported with their line number and skipped.
+// Returns the number of malformed lines, or -1 if the file couldn't be opened.
+int forEachRecord(const QString &path, const std::function<bool(RecordParser &fields, std::string_view line)> &parseLine);
+
+#endif // RECORDPARSER_H
@@ -0,0 +1,136 @@
+#include "recordwriter.h"
+#include "metrics.h"
+#include "iothread.h"
+#include <QFileInfo>
+#include <QStringList>
+
+namespace {
+DurabilityPolicy globalDefault;
+}
+
+DurabilityPolicy DurabilityPolicy::fromString(const QString &text, bool *ok) {
+    DurabilityPolicy policy;
+    const QStringList parts = text.trimmed().toLower().split(':');
+    bool valid = true;
+
+    if (parts[0] == "each" && parts.size() == 1) {
+        policy.mode = FlushEachWrite;
+    } else if (parts[0] == "sync" && parts.size() == 1) {
+        policy.mode = SyncOnCommit;
+    } else if (parts[0] == "batch" && parts.size() <= 3) {
+        policy.mode = Batched;
+        if (parts.size() > 1) {
+            policy.maxRecords = parts[1].toInt(&valid);
+            valid = valid && policy.maxRecords > 0;
+        }
+        if (valid && parts.size() > 2) {
+            policy.maxDelayMs = parts[2].toInt(&valid);
+            valid = valid && policy.maxDelayMs >= 0;
+        }
+    } else {
+        valid = false;
+    }
+
+    if (ok)
+        *ok = valid;
+    return valid ? policy : DurabilityPolicy();
+}
+
+QString DurabilityPolicy::toString() const {
+    switch (mode) {
+        case FlushEachWrite: return "each";
+        case SyncOnCommit: return "sync";
+        case Batched: return QString("batch:%1:%2").arg(maxRecords).arg(maxDelayMs);
+    }
+    return QString();
+}
+
+DurabilityPolicy DurabilityPolicy::defaultPolicy() {
+    return globalDefault;
+}
+
+void DurabilityPolicy::setDefaultPolicy(const DurabilityPolicy &policy) {
+    globalDefault = policy;
+}
+
+// CONSTRUCTORS
+RecordWriter::RecordWriter(const QString &path)
+    : RecordWriter(path, DurabilityPolicy::defaultPolicy())
+{
+}
+
+RecordWriter::RecordWriter(const QString &path, const DurabilityPolicy &policy)
+    : filePath(path)
+    , policy(policy)
+    , stats(std::make_shared<WriterStats>())
+    , knownSize(-1)
+{
+}
+
+// DESTRUCTOR
+RecordWriter::~RecordWriter() {
+    close(); // Whatever is still queued goes out before the I/O thread stops
+}
+
+bool RecordWriter::write(const char *data, qint64 size) {
+    return write(QByteArray(data, int(size)));
+}
+
+bool RecordWriter::write(const QByteArray &data) {
+    const qint64 sizeBefore = this->size();
+    lastWrite = IoThread::instance().append(filePath, data, policy, stats);
+    Metrics::recordsAppended.add();
+
+    if (policy.mode == DurabilityPolicy::SyncOnCommit && !lastWrite.get()) {
+        knownSize = sizeBefore; // The I/O thread cut the file back
+        stats->failed.store(false);
+        return false;
+    }
+    knownSize = sizeBefore + data.size();
+    return true;
+}
+
+bool RecordWriter::flush() {
+    return IoThread::instance().barrier().get() && (!lastWrite.valid() || lastWrite.get());
+}
+
+void RecordWriter::close() {
+    IoThread::instance().close(filePath);
+}
+
+qint64 RecordWriter::size() {
+    if (stats->failed.exchange(false)) { // Some queued write didn't make it, only the disk knows the real size now
+        IoThread::instance().barrier().wait();
+        knownSize = -1;
+    }
+    if (knownSize < 0) {
+        knownSize = QFileInfo(filePath).size(); // Only right when nothing is queued, which is the case the first time
+    }
+    return knownSize;
+}
+
+std::shared_future<bool> RecordWriter::truncate(qint64 newSize) {
+    if (size() <= newSize) {
+        std::promise<bool> nothingToDo;
+        nothingToDo.set_value(true);
+        return nothingToDo.get_future().share();
+    }
+    knownSize = newSize;
+    return IoThread::instance().truncate(filePath, newSize);
+}
+
+void RecordWriter::forgetSize() {
+    knownSize = -1;
+}
+
+quint64 RecordWriter::bytesWrittenCount() const {
+    return stats->bytesWritten.load();
+}
+
+quint64 RecordWriter::flushCount() const {
+    return stats->flushes.load();
+}
+
+quint64 RecordWriter::syncCount() const {
+    return stats->syncs.load();
+}
@@ -0,0 +1,72 @@
+#ifndef RECORDWRITER_H
+#define RECORDWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <future>
+#include <memory>
+#include <vector>
+
+struct WriterStats; // iothread.h
+
+using WriteCompletions = std::vector<std::shared_future<bool>>; // What a change queued, for whoever needs to know how it went
+
+// How hard the I/O thread tries to get a writer's records onto the disk
+struct DurabilityPolicy {
+    enum Mode {
+        FlushEachWrite, // Every group of writes goes to the OS as soon as the I/O thread gets to it
+        Batched, // Held back until maxRecords writes or maxDelayMs have piled up, a crash can lose that much
+        SyncOnCommit // Every group is fsync'd, and write() waits for it. Slowest, but survives power loss
+    };
+
+    Mode mode = FlushEachWrite;
+    int maxRecords = 32; // Batched only
+    int maxDelayMs = 1000; // Batched only
+
+    // "each", "batch", "batch:<records>", "batch:<records>:<ms>" or "sync", ok is false for anything else
+    static DurabilityPolicy fromString(const QString &text, bool *ok = nullptr);
+    QString toString() const;
+
+    // What every RecordWriter starts with, main sets it from --durability or SARISARI_DURABILITY
+    static DurabilityPolicy defaultPolicy();
+    static void setDefaultPolicy(const DurabilityPolicy &policy);
+};
+
+// Appends to one file through the I/O thread (see iothread.h), so writing never waits on the disk
+// unless the policy says so. One write() is one logical change (a record or a whole batch of them):
+// if it fails on the I/O thread, none of it ends up in the file.
+class RecordWriter {
+    private:
+        QString filePath;
+        DurabilityPolicy policy;
+        std::shared_ptr<WriterStats> stats;
+        qint64 knownSize; // File size once everything queued so far is written, -1 until it's looked up
+        std::shared_future<bool> lastWrite;
+
+    public:
+        explicit RecordWriter(const QString &path);
+        RecordWriter(const QString &path, const DurabilityPolicy &policy);
+        ~RecordWriter();
+
+        RecordWriter(const RecordWriter &) = delete;
+        RecordWriter &operator=(const RecordWriter &) = delete;
+
+        // Queues the data. Returns false only if it's already known not to have made it,
+        // which for SyncOnCommit means it waited for the fsync
+        bool write(const char *data, qint64 size);
+        bool write(const QByteArray &data);
+        std::shared_future<bool> lastWriteCompletion() const { return lastWrite; } // For callers that need to know how it went
+
+        bool flush(); // Waits until everything queued so far is on disk
+        void close(); // The I/O thread lets go of the file, queued like everything else
+        qint64 size(); // File size including what's still queued
+        std::shared_future<bool> truncate(qint64 newSize); // Queued, drops everything past newSize. Already true if there's nothing to drop
+        void forgetSize(); // The file was replaced or removed behind the writer's back, look the size up again
+
+        QString path() const { return filePath; }
+        quint64 bytesWrittenCount() const;
+        quint64 flushCount() const;
+        quint64 syncCount() const;
+};
+
+#endif // RECORDWRITER_H
@@ -0,0 +1,66 @@
+#include "salesrollup.h"
+#include <algorithm>
+
+void SalesRollup::clear() {
+    products.clear();
+}
+
+void SalesRollup::add(const QString &productName, const QDate &date, int quantity) {
+    const qint64 day = date.toJulianDay();
+    QVector<DaySales> &days = products[productName];
+
+    if (days.isEmpty() || days.last().day < day) { // A new day, the usual case
+        days.append(DaySales{day, quantity});
+    } else if (days.last().day == day) { // Same day as the last sale
+        days.last().quantity += quantity;
+    } else { // Older than the newest bucket, only happens if the clock went back or history was imported out of order
+        auto it = std::lower_bound(days.begin(), days.end(), day,
+                                   [](const DaySales &bucket, qint64 wanted) { return bucket.day < wanted; });
+        if (it != days.end() && it->day == day) {
+            it->quantity += quantity;
+        } else {
+            days.insert(it, DaySales{day, quantity});
+        }
+    }
+}
+
+void SalesRollup::subtract(const QString &productName, const QDate &date, int quantity) {
+    auto product = products.find(productName);
+    if (product == products.end())
+        return;
+
+    const qint64 day = date.toJulianDay();
+    QVector<DaySales> &days = product.value();
+    auto it = std::lower_bound(days.begin(), days.end(), day,
+                               [](const DaySales &bucket, qint64 wanted) { return bucket.day < wanted; });
+    if (it == days.end() || it->day != day)
+        return;
+
+    it->quantity -= quantity;
+    if (it->quantity <= 0) { // Empty buckets would make the product show up with 0 sold
+        days.erase(it);
+        if (days.isEmpty())
+            products.erase(product);
+    }
+}
+
+QVector<QPair<QString, int>> SalesRollup::totalsSince(const QDate &firstDay) const {
+    const qint64 first = firstDay.toJulianDay();
+    QVector<QPair<QString, int>> totals;
+    totals.reserve(products.size());
+
+    for (auto product = products.constBegin(); product != products.constEnd(); ++product) {
+        const QVector<DaySales> &days = product.value();
+        auto it = std::lower_bound(days.constBegin(), days.constEnd(), first,
+                                   [](const DaySales &bucket, qint64 wanted) { return bucket.day < wanted; });
+        if (it == days.constEnd())
+            continue; // Nothing sold in the period
+
+        int sold = 0;
+        for (; it != days.constEnd(); ++it) {
+            sold += it->quantity;
+        }
+        totals.append(qMakePair(product.key(), sold));
+    }
+    return totals;
+}
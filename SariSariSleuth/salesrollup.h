@@ -0,0 +1,30 @@
+#ifndef SALESROLLUP_H
+#define SALESROLLUP_H
+
+#include <QDate>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+// Units sold per product per day, kept up to date as transactions get confirmed
+// so the analytics never have to go through the raw history again.
+class SalesRollup {
+    private:
+        struct DaySales {
+            qint64 day; // QDate::toJulianDay
+            int quantity;
+        };
+        QHash<QString, QVector<DaySales>> products; // Buckets sorted by day, oldest first
+
+    public:
+        void clear();
+        void add(const QString &productName, const QDate &date, int quantity); // O(1) unless the date is older than the newest bucket
+        void subtract(const QString &productName, const QDate &date, int quantity); // Takes back an add, for rolling back a failed confirm
+
+        // Units sold per product from firstDay up to today. Only products with a bucket in that range show up,
+        // and each one costs a binary search plus one add per day in the range.
+        QVector<QPair<QString, int>> totalsSince(const QDate &firstDay) const;
+};
+
+#endif // SALESROLLUP_H
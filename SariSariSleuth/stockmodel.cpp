@@ -1,13 +1,30 @@
 #include "stockmodel.h"
+#include "trace.h"
+#include "metrics.h"
+#include "recordparser.h"
 #include <QDebug>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include "iothread.h"
+#include "durablefile.h"
+#include "recordframe.h"
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <climits>
 
 // CONSTRUCTOR
-StockModel::StockModel(QObject *parent) : QAbstractTableModel(parent) {
-    readDataFromFile();
+StockModel::StockModel(QObject *parent) : QAbstractTableModel(parent), journalWriter(JOURNAL_FILE), journalSeq(0), journalBytes(0) {
+    // Starts out empty, MainWindow loads the files on a worker thread (see loadFromDisk)
+}
+
+// DESTRUCTOR
+StockModel::~StockModel() {
+    waitForCompaction(); // Let a running compaction finish writing the base file
 }
 
 // NECESSARY OVERRIDES
@@ -16,7 +33,7 @@ int StockModel::rowCount(const QModelIndex &parent) const {
     // Must be implemented when inheriting QAbstractTableModel
     if (parent.isValid()) // DO NOT CHANGE, this is in documentation
         return 0;
-    return filteredItems.size();
+    return filteredRows.size();
 }
 
 int StockModel::columnCount(const QModelIndex &parent) const {
@@ -28,11 +45,11 @@ int StockModel::columnCount(const QModelIndex &parent) const {
 }
 
 QVariant StockModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= filteredItems.size() || index.column() >= 6) // In documentation
+    if (!index.isValid() || index.row() >= filteredRows.size() || index.column() >= 6) // In documentation
         return QVariant();
 
     if (role == Qt::DisplayRole || role == Qt::EditRole) {
-        const StockItem &item = filteredItems[index.row()];
+        const StockItem &item = items[filteredRows[index.row()]];
         switch (index.column()) { // Our data
             case 0: return item.id;
             case 1: return item.productName;
@@ -71,10 +88,11 @@ bool StockModel::setData(const QModelIndex &index, const QVariant &value, int ro
     if (!index.isValid() || role != Qt::EditRole)
         return false;
 
-    if (index.row() >= filteredItems.size() || index.column() >= 6)
+    if (index.row() >= filteredRows.size() || index.column() >= 6)
         return false;
 
-    StockItem &item = filteredItems[index.row()];
+    StockItem item = items[filteredRows[index.row()]]; // Copy, the id may be the thing being edited
+    const int oldId = item.id;
 
     // What the function returns
     bool success = false;
@@ -102,13 +120,8 @@ bool StockModel::setData(const QModelIndex &index, const QVariant &value, int ro
     }
 
     if (success) {
-        emit dataChanged(index, index);
-
-        // Update the main items list
-        int mainIndex = items.indexOf(item);
-        if (mainIndex != -1) {
-            items[mainIndex] = item;
-        }
+        // Looked up by the id from before the edit, updates both lists and emits dataChanged
+        success = updateItemById(oldId, item);
     }
 
     return success;
@@ -128,215 +141,558 @@ Qt::ItemFlags StockModel::flags(const QModelIndex &index) const {
 }
 
 // ACTUAL IMPLEMENTED METHODS
-void StockModel::writeItemToFile(const StockItem &item) {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ofstream file(DATA_FILE.toStdString(), std::ios::app); // Append
-    if (file.is_open()) {
-        file << item.id << "|" << item.productName.toStdString() << "|" << item.price << "|" << item.stock << "|" << item.remaining << "|" << item.sold << std::endl;
-        file.close();
-    }
+
+// Formats an item the same way it is laid out in stock_data.txt
+static std::string formatItem(const StockItem &item) {
+    std::ostringstream oss;
+    oss << item.id << "|" << item.productName.toStdString() << "|" << item.price << "|" << item.stock << "|" << item.remaining << "|" << item.sold;
+    return oss.str();
 }
 
-void StockModel::updateItemInFile(const StockItem &oldItem, const StockItem &newItem) {
-    std::ifstream inFile(DATA_FILE.toStdString());
-    std::ofstream outFile("Data/temp.txt");
-    std::string line;
-    
-    if (inFile.is_open() && outFile.is_open()) {
-        while (std::getline(inFile, line)) {
-            std::istringstream iss(line);
-            std::string idStr;
-            std::getline(iss, idStr, '|');
-            int id = std::stoi(idStr);
-            
-            if (id == oldItem.id) {
-                // Write the new item data
-                outFile << newItem.id << "|"
-                       << newItem.productName.toStdString() << "|"
-                       << newItem.price << "|"
-                       << newItem.stock << "|"
-                       << newItem.remaining << "|"
-                       << newItem.sold << std::endl;
-            } else {
-                // Write the original line
-                outFile << line << std::endl;
-            }
-        }
-        
-        inFile.close();
-        outFile.close();
-        
-        // Replace the original file with the temporary file
-        std::remove(DATA_FILE.toStdString().c_str());
-        std::rename("Data/temp.txt", DATA_FILE.toStdString().c_str());
+// Reads the six item fields off a record, used for both the base file and the journal
+static bool readItem(RecordParser &fields, StockItem &item) {
+    return fields.nextInt(item.id) // Read ID
+        && fields.nextString(item.productName) // Read Product Name
+        && fields.nextDouble(item.price) // Read Price
+        && fields.nextInt(item.stock) // Read Stock
+        && fields.nextInt(item.remaining) // Read Remaining
+        && fields.nextInt(item.sold); // Read Sold
+}
+
+// Journal records look like "seq|U|<item fields>" (add or update) or "seq|D|id" (delete), framed like every other line.
+// The base file starts with "#journal|seq" once it has been compacted, so records up to
+// that sequence number are already folded in and get skipped on replay.
+std::string StockModel::journalRecord(const StockItem &item) {
+    return frameRecord(std::to_string(++journalSeq) + "|U|" + formatItem(item));
+}
+
+std::string StockModel::journalDelete(int id) {
+    return frameRecord(std::to_string(++journalSeq) + "|D|" + std::to_string(id));
+}
+
+bool StockModel::appendJournal(const std::string &records) {
+    SARI_TRACE_SCOPE("StockModel::appendJournal");
+    if (!journalWriter.write(records.data(), qint64(records.size()))) // Either all of it or none of it
+        return false;
+    journalBytes += qint64(records.size());
+
+    if (journalBytes >= JOURNAL_COMPACT_BYTES) {
+        compactJournal(true);
     }
+    return true;
 }
 
-void StockModel::deleteItemFromFile(int id) {
-    std::ifstream inFile(DATA_FILE.toStdString());
-    std::ofstream outFile("Data/temp.txt");
-    std::string line;
-    bool found = false;
-    
-    if (inFile.is_open() && outFile.is_open()) {
-        while (std::getline(inFile, line)) {
-            std::istringstream iss(line);
-            std::string idStr;
-            std::getline(iss, idStr, '|');
-            int currentId = std::stoi(idStr);
-            
-            if (currentId != id) {
-                outFile << line << std::endl;
-            } else {
-                found = true;
-            }
+void StockModel::compactJournal(bool inBackground) {
+    SARI_TRACE_SCOPE("StockModel::compactJournal");
+
+    // Called by appendJournal once the journal is big enough, and by readDataFromFile
+    // when the app died halfway through a previous compaction
+
+    if (compaction.valid() && compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return; // One at a time, the journal just keeps growing meanwhile
+
+    // items already has every journal record applied, so the base file is rewritten from a snapshot
+    const QVector<StockItem> snapshot = items; // Implicitly shared, so this doesn't copy yet
+    const qint64 snapshotSeq = journalSeq;
+    const QString journalFile = JOURNAL_FILE;
+    const QString oldJournalFile = OLD_JOURNAL_FILE;
+    const QString dataFile = DATA_FILE;
+
+    // Runs on the I/O thread right after the last record queued before it, and before any queued after it,
+    // so the journal it folds holds exactly the records up to snapshotSeq
+    auto compact = [snapshot, snapshotSeq, dataFile, journalFile, oldJournalFile]() {
+        // Set aside first, so a crash while folding leaves something readDataFromFile can finish
+        if (!QFile::exists(oldJournalFile) && QFile::exists(journalFile)) {
+            renameDurably(journalFile, oldJournalFile);
         }
-        
-        inFile.close();
-        outFile.close();
-        
-        if (found) {
-            // Replace the original file with the temporary file
-            std::remove(DATA_FILE.toStdString().c_str());
-            std::rename("Data/temp.txt", DATA_FILE.toStdString().c_str());
-        } else {
-            // If item wasn't found, remove the temporary file
-            std::remove("Data/temp.txt");
+
+        std::string contents = frameRecord("#journal|" + std::to_string(snapshotSeq));
+        for (const StockItem &item : snapshot) {
+            contents += frameRecord(formatItem(item));
         }
+        if (!replaceFileDurably(dataFile, QByteArray(contents.data(), int(contents.size()))))
+            return false;
+
+        // Both journals are in the base file now. Records queued after this task start a fresh one
+        QFile::remove(oldJournalFile);
+        QFile::remove(journalFile);
+        return true;
+    };
+
+    compaction = IoThread::instance().run(compact);
+    if (!inBackground) {
+        compaction.wait();
+    }
+    journalBytes = 0;
+}
+
+void StockModel::waitForCompaction() {
+    SARI_TRACE_SCOPE("StockModel::waitForCompaction");
+    if (compaction.valid()) {
+        compaction.wait();
     }
 }
 
 void StockModel::addItem(const StockItem &item) {
+    SARI_TRACE_SCOPE("StockModel::addItem");
 
     // Only called by onAddButtonClicked
 
-    beginInsertRows(QModelIndex(), items.size(), items.size()); // Must be called before insertion of data
     items.append(item);
-    if (currentFilter.isEmpty() || item.productName.contains(currentFilter, Qt::CaseInsensitive)) {
-        filteredItems.append(item);
+    itemIndex.insert(item.id, items.size() - 1);
+    nameIndex[item.productName].append(items.size() - 1);
+    ids.reserve(item.id);
+    trigrams.insert(item.id, item.productName);
+    if (matchesFilter(item)) {
+        beginInsertRows(QModelIndex(), filteredRows.size(), filteredRows.size()); // Must be called before insertion of data
+        filteredRows.append(items.size() - 1);
+        rowOf.append(filteredRows.size() - 1);
+        endInsertRows(); // Must be called at the end of insertion
+    } else {
+        rowOf.append(-1);
     }
-    writeItemToFile(item);
-    endInsertRows(); // Must be called at the end of insertion
+    appendJournal(journalRecord(item));
+    emit stockChanged();
 }
 
 void StockModel::removeItem(int row) {
+    SARI_TRACE_SCOPE("StockModel::removeItem");
 
     // Only called by onDeleteButtonClicked
 
-    if (row < 0 || row >= filteredItems.size()) // Guard
+    if (row < 0 || row >= filteredRows.size()) // Guard
         return;
 
     beginRemoveRows(QModelIndex(), row, row); // Must be called BEFORE removal of data
-    StockItem item = filteredItems[row];
-    filteredItems.removeAt(row);
-    items.removeOne(item);
-    deleteItemFromFile(item.id);
+    const int position = filteredRows[row];
+    const int id = items[position].id;
+    filteredRows.removeAt(row);
+    items.removeAt(position);
+    for (int &visible : filteredRows) { // Everything after the removed item moved up one
+        if (visible > position)
+            visible--;
+    }
+    rebuildIndexes();
+    trigrams.remove(id);
+    ids.release(id);
+    appendJournal(journalDelete(id));
     endRemoveRows(); // Must be called at the end of removal
+    emit stockChanged();
 }
 
 void StockModel::updateItem(int row, const StockItem &item) {
 
-    // Called by onConfirmTransactionClicked (to change the remaining and sold)
-    // and by onEditButtonClicked (to edit an item)
+    // Called by onEditButtonClicked (to edit an item)
 
-    if (row < 0 || row >= filteredItems.size()) // Guard
+    if (row < 0 || row >= filteredRows.size()) // Guard
         return;
 
-    StockItem oldItem = filteredItems[row];
-    filteredItems[row] = item;
-    
-    // Find the item in the main list
-    for (int i = 0; i < items.size(); i++) {
-        if (items[i].id == item.id) {
-            items[i] = item;
-            break;
+    updateItemById(items[filteredRows[row]].id, item);
+}
+
+bool StockModel::updateItemById(int id, const StockItem &item) {
+    SARI_TRACE_SCOPE("StockModel::updateItemById");
+    Metrics::ScopedTimer timer(Metrics::stockEdit);
+
+    // Called by updateItem and setData
+
+    auto master = itemIndex.constFind(id);
+    if (master == itemIndex.constEnd())
+        return false;
+    if (item.id != id && itemIndex.contains(item.id)) // Another item has that id, the journal would let this one replace it on the next load
+        return false;
+
+    std::string records;
+    applyUpdate(master.value(), item, records);
+    appendJournal(records); // One small record instead of rewriting the whole stock file
+    emit stockChanged();
+    return true;
+}
+
+bool StockModel::updateItemsById(const QVector<StockItem> &changed, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("StockModel::updateItemsById");
+
+    // Called by InventoryService::confirmPending with every item the selected transactions touch, and with
+    // what they were before to roll it back
+
+    // Every id has to be there before anything changes
+    QVector<int> positions;
+    positions.reserve(changed.size());
+    for (const StockItem &item : changed) {
+        auto master = itemIndex.constFind(item.id);
+        if (master == itemIndex.constEnd())
+            return false;
+        positions.append(master.value());
+    }
+
+    const qint64 seqBefore = journalSeq;
+    QVector<StockItem> previous;
+    previous.reserve(changed.size());
+    std::string records;
+    for (int i = 0; i < changed.size(); i++) {
+        previous.append(items[positions[i]]);
+        applyUpdate(positions[i], changed[i], records);
+    }
+
+    if (!appendJournal(records)) {
+        // Put everything back the way it was, newest first in case an item shows up twice
+        std::string discarded;
+        for (int i = changed.size() - 1; i >= 0; i--) {
+            applyUpdate(positions[i], previous[i], discarded);
         }
+        journalSeq = seqBefore;
+        return false;
+    }
+    if (written) // If it fails, the rollback's own records undo it, even when a compaction folded it into the base file first
+        written->push_back(journalWriter.lastWriteCompletion());
+    emit stockChanged();
+    return true;
+}
+
+void StockModel::applyUpdate(int position, const StockItem &item, std::string &records) {
+
+    // Called by updateItemById and updateItemsById
+
+    const int id = items[position].id;
+    const bool renamed = item.productName != items[position].productName;
+    if (item.id != id || renamed) {
+        trigrams.remove(id);
+        trigrams.insert(item.id, item.productName);
+    }
+    items[position] = item; // The only copy, the filtered view just points at it
+    if (renamed) {
+        rebuildNameIndex(); // Another item may share the old name, renames are rare enough to just redo it
+    }
+    const int row = rowOf[position];
+
+    if (item.id != id) { // Only setData can change the id
+        itemIndex.remove(id);
+        itemIndex.insert(item.id, position);
+        ids.release(id);
+        ids.reserve(item.id);
+        records += journalDelete(id);
+    }
+
+    records += journalRecord(item);
+    if (row != -1) {
+        emit dataChanged(index(row, 0), index(row, columnCount() - 1)); // Tells the views to repaint the row
     }
-    
-    updateItemInFile(oldItem, item);
-    emit dataChanged(index(row, 0), index(row, columnCount() - 1)); // TODO: IS THIS EVEN USED??
 }
 
 StockItem StockModel::getItem(int row) const {
-    if (row >= 0 && row < filteredItems.size())
-        return filteredItems[row];
+    if (row >= 0 && row < filteredRows.size())
+        return items[filteredRows[row]];
     return StockItem();
 }
 
+const StockItem *StockModel::findById(int id) const {
+    auto it = itemIndex.constFind(id);
+    if (it == itemIndex.constEnd())
+        return nullptr;
+    return &items[it.value()];
+}
+
+bool StockModel::isOutOfStock(const QString &productName) const {
+
+    // Called by HowMuchModel::updateRecommendations
+
+    auto it = nameIndex.constFind(productName);
+    if (it == nameIndex.constEnd())
+        return false;
+    for (int position : it.value()) {
+        if (items[position].remaining == 0)
+            return true;
+    }
+    return false;
+}
+
+int StockModel::nextFreeId() {
+    return ids.lowestFree();
+}
+
+void StockModel::rebuildIndexes() {
+    itemIndex.clear();
+    itemIndex.reserve(items.size());
+    for (int i = 0; i < items.size(); i++) {
+        itemIndex.insert(items[i].id, i);
+    }
+    rebuildNameIndex();
+    rebuildRowOf();
+}
+
+void StockModel::rebuildNameIndex() {
+    nameIndex.clear();
+    nameIndex.reserve(items.size());
+    for (int i = 0; i < items.size(); i++) {
+        nameIndex[items[i].productName].append(i);
+    }
+}
+
+void StockModel::rebuildRowOf() {
+    rowOf.fill(-1, items.size());
+    for (int i = 0; i < filteredRows.size(); i++) {
+        rowOf[filteredRows[i]] = i;
+    }
+}
+
 void StockModel::filterItems(const QString &text) {
+    SARI_TRACE_SCOPE("StockModel::filterItems");
+    Metrics::ScopedTimer timer(Metrics::filterKeystroke);
 
-    // Called by onFilterTextChanged in the main window
+    // Called by onFilterTextChanged in the main window, so once per keystroke
 
-    beginResetModel(); // Begins the reset of any data
-    currentFilter = text; // The current filter
-    filteredItems.clear(); // Resets the filtered items
-    
-    if (text.isEmpty()) { // In the case where the text changes to be empty
-        filteredItems = items;
-    } else {
+    const QString query = TrigramIndex::fold(text);
+    const QString previous = currentFilter;
+    currentFilter = query; // The current filter
+
+    // Positions in items of everything that should be visible, in the same order as items
+    QVector<int> positions;
+    if (query.isEmpty()) { // In the case where the text changes to be empty
+        positions.reserve(items.size());
+        for (int i = 0; i < items.size(); i++) {
+            positions.append(i);
+        }
+    } else if (!previous.isEmpty() && query.contains(previous)) {
+        // The query got longer, so the matches can only be some of what's already showing
+        for (int position : filteredRows) {
+            if (trigrams.matches(items[position].id, query)) {
+                positions.append(position);
+            }
+        }
+    } else if (query.size() >= 3) {
+        // Only look at the items that share every trigram with the query
+        for (int id : trigrams.candidates(query)) {
+            if (trigrams.matches(id, query)) {
+                positions.append(itemIndex.value(id));
+            }
+        }
+        std::sort(positions.begin(), positions.end());
+    } else { // Too short for trigrams, check everything
         for (int i = 0; i < items.size(); i++) {
-            if (items[i].productName.contains(text, Qt::CaseInsensitive)) {
-                filteredItems.append(items[i]);
+            if (trigrams.matches(items[i].id, query)) {
+                positions.append(i);
             }
         }
     }
-    endResetModel(); // Ends the reset of any data
+
+    applyFilter(positions);
 }
 
-void StockModel::readDataFromFile() {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ifstream file(DATA_FILE.toStdString());
-    if (!file.is_open()) { //Only happens upon no data
+void StockModel::applyFilter(const QVector<int> &positions) {
+
+    // Turns filteredRows into positions. Both lists are in items order, so they
+    // are merged and every run of rows that disappears or appears gets its own remove/insert signal.
+    // That way the view keeps its selection and scroll position instead of being reset.
+
+    struct Run {
+        bool insert;
+        int row; // Where the run starts in filteredRows at the time it is applied
+        int first; // Into positions for inserts
+        int count;
+    };
+    QVector<Run> runs;
+
+    int row = 0; // Row in filteredRows as it will be once the earlier runs are applied
+    int current = 0; // Into filteredRows as it is now
+    int wanted = 0; // Into positions
+    while (current < filteredRows.size() || wanted < positions.size()) {
+        const int have = current < filteredRows.size() ? filteredRows[current] : INT_MAX;
+        const int want = wanted < positions.size() ? positions[wanted] : INT_MAX;
+        if (have == want) { // Stays
+            current++;
+            wanted++;
+            row++;
+        } else if (have < want) { // Rows that go away
+            int count = 0;
+            while (current < filteredRows.size() && filteredRows[current] < want) {
+                current++;
+                count++;
+            }
+            runs.append(Run{false, row, 0, count});
+        } else { // Rows that show up
+            int count = 0;
+            const int first = wanted;
+            while (wanted < positions.size() && positions[wanted] < have) {
+                wanted++;
+                count++;
+            }
+            runs.append(Run{true, row, first, count});
+            row += count;
+        }
+    }
+
+    if (runs.size() > MAX_FILTER_RUNS) {
+        // Too scattered, one reset is cheaper than thousands of row signals
+        beginResetModel();
+        filteredRows = positions;
+        rebuildRowOf();
+        endResetModel();
         return;
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string thing;
-        StockItem item;
+    for (const Run &run : runs) {
+        if (run.insert) {
+            beginInsertRows(QModelIndex(), run.row, run.row + run.count - 1);
+            filteredRows.insert(run.row, run.count, 0);
+            for (int i = 0; i < run.count; i++) {
+                filteredRows[run.row + i] = positions[run.first + i];
+            }
+            endInsertRows();
+        } else {
+            beginRemoveRows(QModelIndex(), run.row, run.row + run.count - 1);
+            filteredRows.remove(run.row, run.count);
+            endRemoveRows();
+        }
+    }
+    rebuildRowOf(); // Once at the end, nothing the views call in between needs it
+}
 
-        // Read ID
-        std::getline(iss, thing, '|');
-        item.id = std::stoi(thing);
+bool StockModel::matchesFilter(const StockItem &item) const {
+    return currentFilter.isEmpty() || TrigramIndex::fold(item.productName).contains(currentFilter);
+}
 
-        // Read Product Name
-        std::getline(iss, thing, '|');
-        item.productName = QString::fromStdString(thing);
+void StockModel::readDataFromFile() {
+    SARI_TRACE_SCOPE("StockModel::readDataFromFile");
 
-        // Read Price
-        std::getline(iss, thing, '|');
-        item.price = std::stod(thing);
+    // Called by the restore, startup goes through loadFromDisk on a worker and applyLoaded instead
 
-        // Read Stock
-        std::getline(iss, thing, '|');
-        item.stock = std::stoi(thing);
+    // Create Data directory if it doesn't exist
+    QDir().mkpath("Data");
 
-        // Read Remaining
-        std::getline(iss, thing, '|');
-        item.remaining = std::stoi(thing);
+    waitForCompaction(); // Don't read the base file while it is being replaced
+    journalWriter.close();
+    IoThread::instance().barrier().wait(); // Every journal record queued so far is in the file
+    applyLoaded(loadFromDisk());
+}
 
-        // Read Sold
-        std::getline(iss, thing, '|');
-        item.sold = std::stoi(thing);
+StockModel::LoadResult StockModel::loadFromDisk() const {
+    SARI_TRACE_SCOPE("StockModel::loadFromDisk");
+    Metrics::ScopedTimer timer(Metrics::loadStock);
+    LoadResult result;
+    QVector<StockItem> loaded;
+    QHash<int, int> loadedRow; // id -> row in loaded, only needed while replaying the journal
+    QVector<bool> removed; // Rows deleted by the journal, dropped at the end
+    qint64 baseSeq = 0;
+
+    // Missing file only happens upon no data
+    forEachRecord(DATA_FILE, [&](RecordParser &fields, std::string_view line) {
+        if (line.substr(0, 9) == "#journal|") { // Header written by compactJournal
+            RecordParser header(line.substr(9));
+            return header.nextInt64(baseSeq);
+        }
 
-        // Add to both lists
-        items.append(item);
-        filteredItems.append(item); // Unfortunately I do not want to circumvent adding this one line, so here it stays
+        StockItem item;
+        if (!readItem(fields, item))
+            return false;
+        loadedRow[item.id] = loaded.size();
+        loaded.append(item);
+        removed.append(false);
+        return true;
+    });
+
+    // Replay the journals on top of the base file. OLD_JOURNAL_FILE only exists when the
+    // app died during a compaction, and everything in it is older than JOURNAL_FILE
+    qint64 journalSeq = baseSeq;
+    result.interruptedCompaction = QFile::exists(OLD_JOURNAL_FILE);
+    for (const QString &journalFile : {OLD_JOURNAL_FILE, JOURNAL_FILE}) {
+        forEachRecord(journalFile, [&](RecordParser &fields, std::string_view) {
+            qint64 seq;
+            std::string_view operation;
+            if (!fields.nextInt64(seq) || !fields.next(operation))
+                return false;
+            journalSeq = std::max(journalSeq, seq);
+            if (seq <= baseSeq) // Already folded into the base file
+                return true;
+
+            if (operation == "D") {
+                int id;
+                if (!fields.nextInt(id))
+                    return false;
+                auto it = loadedRow.find(id);
+                if (it != loadedRow.end()) {
+                    removed[it.value()] = true;
+                    loadedRow.erase(it);
+                }
+            } else if (operation == "U") {
+                StockItem item;
+                if (!readItem(fields, item))
+                    return false;
+                auto it = loadedRow.find(item.id);
+                if (it != loadedRow.end()) {
+                    loaded[it.value()] = item;
+                } else { // New items are appended, same as addItem does
+                    loadedRow[item.id] = loaded.size();
+                    loaded.append(item);
+                    removed.append(false);
+                }
+            } else {
+                return false;
+            }
+            return true;
+        });
     }
 
-    file.close();
+    result.items.reserve(loaded.size());
+    for (int i = 0; i < loaded.size(); i++) {
+        if (!removed[i]) {
+            result.items.append(loaded[i]);
+        }
+    }
+    result.journalSeq = journalSeq;
+    result.journalBytes = QFileInfo(JOURNAL_FILE).size();
+    return result;
+}
+
+void StockModel::applyLoaded(const LoadResult &loaded) {
+    SARI_TRACE_SCOPE("StockModel::applyLoaded");
+    beginResetModel();
+    items = loaded.items;
+    filteredRows.clear();
+    for (int i = 0; i < items.size(); i++) {
+        if (matchesFilter(items[i])) {
+            filteredRows.append(i);
+        }
+    }
+    rebuildIndexes();
+    trigrams.clear();
+    for (const StockItem &item : items) {
+        trigrams.insert(item.id, item.productName);
+    }
+    ids.clear(); // Rebuilt once here, kept up to date by add/remove afterwards
+    for (const StockItem &item : items) {
+        ids.reserve(item.id);
+    }
+    journalSeq = loaded.journalSeq;
+    journalBytes = loaded.journalBytes;
+
+    endResetModel();
+    emit stockChanged();
+
+    if (loaded.interruptedCompaction) {
+        compactJournal(false); // Finish it now, before any new records are written
+    } else if (journalBytes >= JOURNAL_COMPACT_BYTES) {
+        compactJournal(true);
+    }
 }
 
 void StockModel::clear() {
+    SARI_TRACE_SCOPE("StockModel::clear");
+    waitForCompaction();
+    journalWriter.close();
+    IoThread::instance().barrier().wait(); // Nothing queued may land after the files are gone
     beginResetModel();
     items.clear();
-    filteredItems.clear();
-    // Delete the file
+    filteredRows.clear();
+    itemIndex.clear();
+    nameIndex.clear();
+    rowOf.clear();
+    trigrams.clear();
+    ids.clear();
+    // Delete the files
     std::remove(DATA_FILE.toStdString().c_str());
+    std::remove(JOURNAL_FILE.toStdString().c_str());
+    std::remove(OLD_JOURNAL_FILE.toStdString().c_str());
+    journalBytes = 0;
     endResetModel();
-} 
+    emit stockChanged();
+}
@@ -4,7 +4,12 @@
 #include <QAbstractTableModel>
 #include <QVector>
 #include <QString>
+#include <QHash>
+#include <future>
 #include <fstream>
+#include "idallocator.h"
+#include "trigramindex.h"
+#include "recordwriter.h"
 
 struct StockItem { // Our Stock Item structure
     int id; // Used to display on the StockModel
@@ -28,18 +33,51 @@ class StockModel : public QAbstractTableModel {
     Q_OBJECT
     private:
         QVector<StockItem> items; // The whole stock
-        QVector<StockItem> filteredItems; // The filtered stock, our actual working copy of the items
-        QString currentFilter; // The filter
+        QVector<int> filteredRows; // The filtered stock as positions in items, row i of the view shows items[filteredRows[i]]
+        QString currentFilter; // The filter, case-folded
+        TrigramIndex trigrams; // Over every item's name, see filterItems
+        static const int MAX_FILTER_RUNS = 256; // Past this many separate row ranges a reset is cheaper than row signals
+        QHash<int, int> itemIndex; // id -> position in items
+        QHash<QString, QVector<int>> nameIndex; // Product name -> positions in items of every item with that name, names can repeat
+        QVector<int> rowOf; // Position in items -> row in filteredRows, -1 if it's filtered out
+        IdAllocator ids; // Free ids for new items
         const QString DATA_FILE = "Data/stock_data.txt";
+        const QString JOURNAL_FILE = "Data/stock_journal.txt"; // Edits since the last compaction
+        const QString OLD_JOURNAL_FILE = "Data/stock_journal.old.txt"; // Edits being folded in by a running compaction
+        static const qint64 JOURNAL_COMPACT_BYTES = 64 * 1024; // Fold the journal into DATA_FILE past this size
+        RecordWriter journalWriter; // Appends to JOURNAL_FILE through the I/O thread
+
+        qint64 journalSeq; // Sequence number of the last journal record written
+        qint64 journalBytes; // Current size of JOURNAL_FILE
+        std::shared_future<bool> compaction; // The last compaction handed to the I/O thread
 
         // Helper functions for file operations
-        void writeItemToFile(const StockItem &item);
-        void updateItemInFile(const StockItem &oldItem, const StockItem &newItem);
-        void deleteItemFromFile(int id);
+        std::string journalRecord(const StockItem &item); // Upsert record, takes the next sequence number
+        std::string journalDelete(int id); // Delete record, same
+        bool appendJournal(const std::string &records); // One write for any number of records, all or nothing
+        void applyUpdate(int position, const StockItem &item, std::string &records); // In memory only, the journal records go into records
+        void compactJournal(bool inBackground);
+        void waitForCompaction();
+        void rebuildIndexes();
+        void rebuildNameIndex();
+        void rebuildRowOf();
+        bool matchesFilter(const StockItem &item) const;
+        void applyFilter(const QVector<int> &positions);
 
     public:
         explicit StockModel(QObject *parent = nullptr); // Constructor
-        void readDataFromFile(); // New method to read initial data
+        ~StockModel();
+        void readDataFromFile(); // Reads everything again right here, e.g. after a restore
+
+        // Loading split in two, so the slow part can run on a worker while the model sits empty
+        struct LoadResult {
+            QVector<StockItem> items;
+            qint64 journalSeq = 0;
+            qint64 journalBytes = 0;
+            bool interruptedCompaction = false;
+        };
+        LoadResult loadFromDisk() const; // Only reads files, safe off the GUI thread
+        void applyLoaded(const LoadResult &loaded); // GUI thread, replaces whatever the model had
 
     // Required overrides for QAbstractTableModel: see in the documentation
         int rowCount(const QModelIndex &parent = QModelIndex()) const override; // const = nothing should change in the object
@@ -53,9 +91,18 @@ class StockModel : public QAbstractTableModel {
         void addItem(const StockItem &item);
         void removeItem(int row);
         void updateItem(int row, const StockItem &item);
+        bool updateItemById(int id, const StockItem &item); // Works even when the item is filtered out. false if item.id is taken by another item
+        // Same for a batch, with one journal write, all or nothing. Adds that write to written
+        bool updateItemsById(const QVector<StockItem> &changed, WriteCompletions *written = nullptr);
         StockItem getItem(int row) const;
+        const StockItem *findById(int id) const; // nullptr if there's no such item, only valid until the next change
+        bool isOutOfStock(const QString &productName) const; // Any item with that name has nothing remaining
+        int nextFreeId(); // Lowest id not used by any item
         void filterItems(const QString &text);
         void clear();
+
+    signals:
+        void stockChanged(); // Any change to the items themselves, filtering doesn't count
 };
 
 #endif
@@ -0,0 +1,417 @@
+// Writes a synthetic Data directory: a catalog, some pending transactions and years of sales history,
+// shaped like a real shop. A few products sell most of the units (Zipf), mornings, lunch and early
+// evening are busy, weekends and December busier still. The same seed always gives the same files,
+// however many threads made them.
+// Usage: sarisari_gen [--out Data] [--seed 42] [--skus 2000] [--rows 1000000] [--pending 20]
+//                     [--years 3] [--end 2025-06-30] [--zipf 1.1] [--threads N] [--binary]
+// --binary writes the column files ConfirmedTransactionModel reads directly, otherwise the history is
+// transaction_history.txt, which the app converts on its first start. Either loads as is into the app
+// and into sarisari_bench --data.
+
+#include "../stockmodel.h"
+#include "../confirmedtransactionmodel.h"
+#include "../binaryhistory.h"
+#include "../recordframe.h"
+#include "../iothread.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char *BRANDS[] = {"Lucky Me", "Nissin", "Payless", "Coke", "Pepsi", "RC", "Bear Brand", "Alaska", "Nescafe",
+                        "Kopiko", "Great Taste", "Safeguard", "Palmolive", "Tide", "Surf", "Champion", "Argentina",
+                        "Purefoods", "Century", "555", "Ligo", "Datu Puti", "Silver Swan", "Marca Pina", "Jack n Jill",
+                        "Oishi", "Rebisco", "Monde", "Magnolia", "Selecta"};
+const char *PRODUCTS[] = {"Pancit Canton", "Instant Mami", "Cola", "Softdrink", "Powdered Milk", "Evaporated Milk",
+                          "3in1 Coffee", "Brewed Coffee", "Bath Soap", "Shampoo", "Detergent Bar", "Powder Detergent",
+                          "Corned Beef", "Meat Loaf", "Tuna Flakes", "Sardines", "Soy Sauce", "Vinegar",
+                          "Crackers", "Biscuits", "Chips", "Wafer", "Ice Cream", "Bread", "Candy", "Noodles",
+                          "Cooking Oil", "Sugar", "Salt", "Rice"};
+const char *SIZES[] = {"Sachet", "Small", "Regular", "Big", "Family", "60g", "150g", "1L"};
+const int BRAND_COUNT = int(sizeof(BRANDS) / sizeof(BRANDS[0]));
+const int PRODUCT_COUNT = int(sizeof(PRODUCTS) / sizeof(PRODUCTS[0]));
+const int SIZE_COUNT = int(sizeof(SIZES) / sizeof(SIZES[0]));
+
+// Shop hours 6:00 to 21:00, busiest before work, at lunch and after work
+const double HOURLY[24] = {0, 0, 0, 0, 0, 0, 0.6, 1.4, 1.1, 0.8, 0.8, 1.2, 1.5, 1.1, 0.8, 0.8, 1.0, 1.4, 1.6, 1.2, 0.8, 0.4, 0, 0};
+const double WEEKDAY[7] = {1.0, 0.95, 0.95, 1.0, 1.1, 1.35, 1.3}; // Monday first, like QDate::dayOfWeek - 1
+const double MONTHLY[12] = {0.9, 0.85, 0.9, 0.95, 1.0, 1.1, 1.0, 0.95, 0.95, 1.0, 1.05, 1.4}; // School opening, then Christmas
+
+const qint64 CHUNK_ROWS = 1 << 16; // Unit of work per thread, and of the seeding, so the thread count doesn't change the output
+
+struct Sku {
+    QString name;
+    std::string nameUtf8;
+    qint64 priceCents;
+};
+
+struct Options {
+    QString out;
+    quint32 seed;
+    int skus;
+    qint64 rows;
+    int pending;
+    int years;
+    QDate end;
+    double zipf;
+    int threads;
+    bool binary;
+};
+
+std::vector<Sku> makeCatalog(const Options &options) {
+    std::mt19937_64 rng(options.seed);
+    std::lognormal_distribution<double> price(std::log(25.0), 0.8); // Mostly 10 to 60 pesos, the odd big bottle
+    const int combinations = BRAND_COUNT * PRODUCT_COUNT * SIZE_COUNT;
+
+    std::vector<Sku> catalog(size_t(options.skus));
+    for (int i = 0; i < options.skus; i++) {
+        const int combination = int((qint64(i) * 7919) % combinations); // Spread the neighbours around the word lists
+        QString name = QString("%1 %2 %3").arg(BRANDS[combination % BRAND_COUNT])
+                           .arg(PRODUCTS[(combination / BRAND_COUNT) % PRODUCT_COUNT])
+                           .arg(SIZES[combination / (BRAND_COUNT * PRODUCT_COUNT)]);
+        if (i >= combinations)
+            name += " " + QString::number(i / combinations + 1); // Names stay unique past every combination
+        catalog[size_t(i)].name = name;
+        catalog[size_t(i)].nameUtf8 = name.toStdString();
+        catalog[size_t(i)].priceCents = std::max<qint64>(500, qint64(std::min(price(rng), 2000.0) * 4) * 25); // Quarter peso steps
+    }
+    return catalog;
+}
+
+// Cumulative popularity, popularity[rank] sells like 1 / (rank + 1)^s. Which SKU has which rank is shuffled
+struct Popularity {
+    std::vector<double> cumulative;
+    std::vector<int> skuOfRank;
+
+    Popularity(int skus, double s, quint32 seed) : cumulative(size_t(skus)), skuOfRank(size_t(skus)) {
+        double total = 0;
+        for (int rank = 0; rank < skus; rank++) {
+            total += 1.0 / std::pow(rank + 1, s);
+            cumulative[size_t(rank)] = total;
+        }
+        for (double &value : cumulative)
+            value /= total;
+        for (int i = 0; i < skus; i++)
+            skuOfRank[size_t(i)] = i;
+        std::shuffle(skuOfRank.begin(), skuOfRank.end(), std::mt19937_64(seed + 1));
+    }
+
+    int sample(double u) const {
+        const size_t rank = size_t(std::upper_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin());
+        return skuOfRank[std::min(rank, skuOfRank.size() - 1)];
+    }
+};
+
+// The history's time axis in hours, each weighted by the seasonality. Row r of n lands at the
+// (r + 0.5) / n quantile, so the rows come out oldest first without sorting anything
+struct Timeline {
+    QDate first;
+    std::vector<double> cumulative; // Per hour since first, normalized to 1
+    std::vector<qint64> hourStart; // Seconds since the epoch, local time like the app's timestamps
+    std::vector<std::string> dayText; // "yyyy-MM-dd" per day
+
+    Timeline(const QDate &end, int years) : first(end.addYears(-years)) {
+        const int days = int(first.daysTo(end)) + 1;
+        cumulative.reserve(size_t(days) * 24);
+        hourStart.reserve(size_t(days) * 24);
+        dayText.reserve(size_t(days));
+        double total = 0;
+        for (int day = 0; day < days; day++) {
+            const QDate date = first.addDays(day);
+            dayText.push_back(date.toString("yyyy-MM-dd").toStdString());
+            const double dayWeight = WEEKDAY[date.dayOfWeek() - 1] * MONTHLY[date.month() - 1];
+            const qint64 midnight = QDateTime(date, QTime(0, 0)).toSecsSinceEpoch();
+            for (int hour = 0; hour < 24; hour++) {
+                total += dayWeight * HOURLY[hour];
+                cumulative.push_back(total);
+                hourStart.push_back(midnight + hour * 3600);
+            }
+        }
+        for (double &value : cumulative)
+            value /= total;
+    }
+
+    // Hour index and seconds into it for quantile q
+    void at(double q, size_t &hour, int &second) const {
+        hour = std::min(size_t(std::lower_bound(cumulative.begin(), cumulative.end(), q) - cumulative.begin()), cumulative.size() - 1);
+        const double before = hour > 0 ? cumulative[hour - 1] : 0.0;
+        const double width = cumulative[hour] - before;
+        second = width > 0 ? std::min(3599, int((q - before) / width * 3600)) : 0;
+    }
+};
+
+void appendNumber(std::string &out, qint64 value) {
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void appendTwoDigits(std::string &out, int value) {
+    out += char('0' + value / 10);
+    out += char('0' + value % 10);
+}
+
+void appendPrice(std::string &out, qint64 cents) {
+    appendNumber(out, cents / 100);
+    out += '.';
+    appendTwoDigits(out, int(cents % 100));
+}
+
+// One chunk of history, both as column rows and, for the text format, as framed lines
+struct Chunk {
+    QVector<ConfirmedTransaction> rows;
+    std::string text;
+    std::vector<std::pair<int, int>> sold; // SKU and units per row, for the catalog's sold column
+};
+
+void generateChunk(qint64 index, const Options &options, const std::vector<Sku> &catalog, const Popularity &popularity,
+                   const Timeline &timeline, Chunk &chunk) {
+    std::seed_seq seeds{options.seed, quint32(index), quint32(index >> 32)};
+    std::mt19937_64 rng(seeds);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::geometric_distribution<int> extra(0.6); // Most sales are a single unit
+
+    const qint64 first = index * CHUNK_ROWS;
+    const qint64 count = std::min(CHUNK_ROWS, options.rows - first);
+    chunk.rows.clear();
+    chunk.text.clear();
+    chunk.sold.clear();
+    chunk.sold.reserve(size_t(count));
+    if (options.binary)
+        chunk.rows.reserve(int(count));
+    else
+        chunk.text.reserve(size_t(count) * 80);
+
+    std::string line;
+    for (qint64 i = 0; i < count; i++) {
+        const qint64 row = first + i;
+        size_t hour;
+        int second;
+        timeline.at((row + 0.5) / options.rows, hour, second);
+        const int sku = popularity.sample(uniform(rng));
+        const int quantity = 1 + std::min(extra(rng), 23);
+        chunk.sold.emplace_back(sku, quantity);
+
+        if (options.binary) {
+            ConfirmedTransaction transaction;
+            transaction.timestamp = timeline.hourStart[hour] + second;
+            transaction.transactionId = int(row + 1);
+            transaction.itemId = sku + 1;
+            transaction.nameId = sku; // Interned in catalog order, see main
+            transaction.quantity = quantity;
+            transaction.priceCents = catalog[size_t(sku)].priceCents;
+            chunk.rows.append(transaction);
+            continue;
+        }
+
+        // Same layout as transaction_history.txt: id|item id|name|price|stock|remaining|sold|quantity|timestamp
+        line.clear();
+        appendNumber(line, row + 1);
+        line += '|';
+        appendNumber(line, sku + 1);
+        line += '|';
+        line += catalog[size_t(sku)].nameUtf8;
+        line += '|';
+        appendPrice(line, catalog[size_t(sku)].priceCents);
+        line += "|0|0|0|";
+        appendNumber(line, quantity);
+        line += '|';
+        line += timeline.dayText[hour / 24];
+        line += ' ';
+        appendTwoDigits(line, int(hour % 24));
+        line += ':';
+        appendTwoDigits(line, second / 60);
+        line += ':';
+        appendTwoDigits(line, second % 60);
+        chunk.text += frameRecord(line);
+    }
+}
+
+bool writeText(const QString &path, const std::string &contents) {
+    std::ofstream out(path.toStdString(), std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), std::streamsize(contents.size()));
+    return bool(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates a synthetic SariSariSleuth Data directory");
+    parser.addHelpOption();
+    QCommandLineOption outOption("out", "Directory to write into, created if needed.", "dir", "Data");
+    QCommandLineOption seedOption("seed", "Seed, the same seed gives the same files.", "seed", "42");
+    QCommandLineOption skusOption("skus", "Products in the catalog.", "n", "2000");
+    QCommandLineOption rowsOption("rows", "Transactions in the history.", "n", "1000000");
+    QCommandLineOption pendingOption("pending", "Pending transactions.", "n", "20");
+    QCommandLineOption yearsOption("years", "How far back the history goes.", "years", "3");
+    QCommandLineOption endOption("end", "Last day of the history (yyyy-MM-dd).", "date", "2025-06-30");
+    QCommandLineOption zipfOption("zipf", "Zipf exponent of product popularity.", "s", "1.1");
+    QCommandLineOption threadsOption("threads", "Worker threads.", "n", QString::number(std::max(1u, std::thread::hardware_concurrency())));
+    QCommandLineOption binaryOption("binary", "Write the history in the binary column format.");
+    parser.addOptions({outOption, seedOption, skusOption, rowsOption, pendingOption, yearsOption, endOption, zipfOption,
+                       threadsOption, binaryOption});
+    parser.process(app);
+
+    Options options;
+    options.out = parser.value(outOption);
+    options.seed = parser.value(seedOption).toUInt();
+    options.skus = std::max(1, parser.value(skusOption).toInt());
+    options.rows = std::max<qint64>(0, parser.value(rowsOption).toLongLong());
+    options.pending = std::max(0, parser.value(pendingOption).toInt());
+    options.years = std::max(1, parser.value(yearsOption).toInt());
+    options.end = QDate::fromString(parser.value(endOption), "yyyy-MM-dd");
+    options.zipf = parser.value(zipfOption).toDouble();
+    options.threads = std::max(1, parser.value(threadsOption).toInt());
+    options.binary = parser.isSet(binaryOption);
+    if (!options.end.isValid()) {
+        std::fprintf(stderr, "Invalid --end: %s\n", qPrintable(parser.value(endOption)));
+        return 1;
+    }
+    if (!QDir().mkpath(options.out)) {
+        std::fprintf(stderr, "Can't create %s\n", qPrintable(options.out));
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QDir out(options.out);
+    const std::vector<Sku> catalog = makeCatalog(options);
+    const Popularity popularity(options.skus, options.zipf, options.seed);
+    const Timeline timeline(options.end, options.years);
+
+    // Nothing from an earlier run may be left over, the app would prefer a stale binary history to the text one
+    for (const QString &file : out.entryList({"stock_*.txt", "pending_transactions.txt", "transaction_history*"}, QDir::Files)) {
+        out.remove(file);
+    }
+
+    BinaryHistory history(out.filePath("transaction_history"));
+    if (options.binary) {
+        for (const Sku &sku : catalog) {
+            if (history.internName(sku.name) < 0) { // Ids follow the catalog, generateChunk relies on it
+                std::fprintf(stderr, "Failed to write the history's names\n");
+                return 1;
+            }
+        }
+    }
+    std::ofstream text;
+    if (!options.binary)
+        text.open(out.filePath("transaction_history.txt").toStdString(), std::ios::binary | std::ios::trunc);
+
+    // Workers take chunks in waves, the main thread writes each wave in order while the next one isn't started yet
+    const qint64 chunks = (options.rows + CHUNK_ROWS - 1) / CHUNK_ROWS;
+    std::vector<qint64> sold(catalog.size(), 0);
+    std::vector<Chunk> wave(size_t(options.threads) * 2);
+    for (qint64 start = 0; start < chunks; start += qint64(wave.size())) {
+        const qint64 count = std::min<qint64>(qint64(wave.size()), chunks - start);
+        std::atomic<qint64> next{0};
+        std::vector<std::thread> workers;
+        for (int t = 0; t < std::min<qint64>(options.threads, count); t++) {
+            workers.emplace_back([&]() {
+                for (qint64 i = next++; i < count; i = next++) {
+                    generateChunk(start + i, options, catalog, popularity, timeline, wave[size_t(i)]);
+                }
+            });
+        }
+        for (std::thread &worker : workers)
+            worker.join();
+
+        for (qint64 i = 0; i < count; i++) {
+            Chunk &chunk = wave[size_t(i)];
+            if (options.binary) {
+                if (!history.append(chunk.rows)) {
+                    std::fprintf(stderr, "Failed to write the history\n");
+                    return 1;
+                }
+            } else {
+                text.write(chunk.text.data(), std::streamsize(chunk.text.size()));
+            }
+            for (const std::pair<int, int> &sale : chunk.sold)
+                sold[size_t(sale.first)] += sale.second;
+        }
+    }
+    if (options.binary) {
+        // append only queues, so a write that failed on the I/O thread (a full disk, say) only shows up here.
+        // The history is the only thing going through it, so any failure at all is one of ours
+        if (!IoThread::instance().barrier().get() || IoThread::failureCount() != 0) {
+            std::fprintf(stderr, "Failed to write the history\n");
+            return 1;
+        }
+    } else if (!text.flush()) {
+        std::fprintf(stderr, "Failed to write the history\n");
+        return 1;
+    }
+    const qint64 historyMs = timer.elapsed();
+
+    // The catalog agrees with the history: sold is what the history sold, remaining is what's on the shelf
+    std::mt19937_64 rng(options.seed + 2);
+    std::uniform_int_distribution<int> shelf(0, 120);
+    std::string stock;
+    std::string line;
+    for (int i = 0; i < options.skus; i++) {
+        const int remaining = shelf(rng) < 6 ? 0 : shelf(rng); // About one in twenty has run out
+        const qint64 itemSold = std::min<qint64>(sold[size_t(i)], INT_MAX / 2);
+        line.clear();
+        appendNumber(line, i + 1);
+        line += '|';
+        line += catalog[size_t(i)].nameUtf8;
+        line += '|';
+        appendPrice(line, catalog[size_t(i)].priceCents);
+        line += '|';
+        appendNumber(line, itemSold + remaining);
+        line += '|';
+        appendNumber(line, remaining);
+        line += '|';
+        appendNumber(line, itemSold);
+        stock += frameRecord(line);
+    }
+
+    // Pending transactions rung up during the last hour of the last day
+    std::string pending;
+    std::uniform_int_distribution<int> minute(0, 59);
+    for (int i = 0; i < options.pending; i++) {
+        const int sku = popularity.sample(std::uniform_real_distribution<double>(0.0, 1.0)(rng));
+        const int m = minute(rng);
+        line.clear();
+        appendNumber(line, i + 1);
+        line += '|';
+        appendNumber(line, sku + 1);
+        line += '|';
+        line += catalog[size_t(sku)].nameUtf8;
+        line += '|';
+        appendPrice(line, catalog[size_t(sku)].priceCents);
+        line += "|1|";
+        line += options.end.toString("yyyy-MM-dd").toStdString();
+        line += " 20:";
+        appendTwoDigits(line, m);
+        line += ":00";
+        pending += frameRecord(line);
+    }
+
+    if (!writeText(out.filePath("stock_data.txt"), stock) || !writeText(out.filePath("pending_transactions.txt"), pending)) {
+        std::fprintf(stderr, "Failed to write the catalog or the pending transactions\n");
+        return 1;
+    }
+    IoThread::instance().shutdown();
+
+    std::fprintf(stderr, "%d products, %d pending, %lld history rows (%s) in %s: history in %lld ms, %lld ms total\n",
+                 options.skus, options.pending, static_cast<long long>(options.rows), options.binary ? "binary" : "text",
+                 qPrintable(options.out), static_cast<long long>(historyMs), static_cast<long long>(timer.elapsed()));
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "trace.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Trace {
+
+std::atomic<bool> enabledFlag{false};
+
+namespace {
+
+const size_t RING_EVENTS = 1 << 16; // Per thread, the oldest get overwritten past this
+
+struct Event {
+    const char *name;
+    qint64 start;
+    qint64 end;
+};
+
+// One per thread that recorded anything. Only its own thread writes events, head is published with
+// release so the writer of the JSON sees whole events up to it. An event overwritten while the JSON is
+// being written can come out torn, which is why main writes it once the other threads are done
+struct Ring {
+    std::vector<Event> events = std::vector<Event>(RING_EVENTS);
+    std::atomic<quint64> head{0}; // Events ever recorded
+    int tid = 0;
+    std::string name;
+};
+
+std::mutex registryMutex; // Only taken when a thread records its first event, and when writing the JSON
+std::vector<std::shared_ptr<Ring>> rings; // Never shrinks, a thread's events outlive it
+QString defaultPath;
+std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+thread_local std::shared_ptr<Ring> currentRing; // Created by the thread's first event
+thread_local const char *currentName = nullptr;
+
+Ring &threadRing() {
+    if (!currentRing) {
+        currentRing = std::make_shared<Ring>();
+        if (currentName)
+            currentRing->name = currentName;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        currentRing->tid = int(rings.size()) + 1;
+        rings.push_back(currentRing);
+    }
+    return *currentRing;
+}
+
+void appendEscaped(std::string &out, const std::string &text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+}
+
+void appendMicros(std::string &out, qint64 ns) { // Chrome wants microseconds, keep the sub-microsecond part
+    out += std::to_string(ns / 1000);
+    out += '.';
+    const int fraction = int(ns % 1000);
+    out += char('0' + fraction / 100);
+    out += char('0' + fraction / 10 % 10);
+    out += char('0' + fraction % 10);
+}
+
+} // namespace
+
+void enable(const QString &path) {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        defaultPath = path;
+        epoch = std::chrono::steady_clock::now();
+    }
+    enabledFlag.store(true, std::memory_order_release);
+    qInfo() << "Tracing on, writing to" << path;
+}
+
+QString outputPath() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return defaultPath;
+}
+
+void setThreadName(const char *name) {
+    currentName = name; // Cheap enough to call whether or not tracing is on, the ring only comes with the first event
+    if (currentRing)
+        currentRing->name = name;
+}
+
+qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char *name, qint64 startNs, qint64 endNs) {
+    Ring &ring = threadRing();
+    const quint64 head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % RING_EVENTS] = Event{name, startNs, endNs};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool writeChromeJson(const QString &path) {
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    QString target = path;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        snapshot = rings;
+        if (target.isEmpty())
+            target = defaultPath;
+    }
+    if (target.isEmpty())
+        return false;
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    quint64 written = 0;
+    for (const std::shared_ptr<Ring> &ring : snapshot) {
+        const std::string tid = std::to_string(ring->tid);
+        if (!ring->name.empty()) {
+            json += first ? "" : ",\n";
+            json += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+            appendEscaped(json, ring->name);
+            json += "\"}}";
+            first = false;
+        }
+
+        const quint64 head = ring->head.load(std::memory_order_acquire);
+        for (quint64 i = head > RING_EVENTS ? head - RING_EVENTS : 0; i < head; i++) {
+            const Event event = ring->events[i % RING_EVENTS];
+            json += first ? "" : ",\n";
+            json += "{\"ph\":\"X\",\"cat\":\"sarisari\",\"name\":\"";
+            appendEscaped(json, event.name);
+            json += "\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            appendMicros(json, event.start);
+            json += ",\"dur\":";
+            appendMicros(json, std::max<qint64>(0, event.end - event.start));
+            json += "}";
+            first = false;
+            written++;
+        }
+    }
+    json += "\n]}\n";
+
+    QSaveFile file(target);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json.data(), qint64(json.size())) != qint64(json.size()) || !file.commit()) {
+        qWarning() << "Failed to write the trace to" << target;
+        return false;
+    }
+    qInfo() << "Wrote" << written << "trace events to" << target;
+    return true;
+}
+
+} // namespace Trace
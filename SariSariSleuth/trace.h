@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+// Scoped timers for finding out where a slow click went. SARI_TRACE_SCOPE("Name") at the top of a
+// function records how long the rest of the scope took, into a ring buffer owned by the thread it
+// ran on, so recording never takes a lock. While tracing is off a span costs one relaxed load.
+// The rings get written out as Chrome/Perfetto JSON (chrome://tracing, ui.perfetto.dev) by
+// Trace::writeChromeJson, main does it at exit and MainWindow on Ctrl+Shift+T.
+// Names must be string literals, only the pointer is kept.
+namespace Trace {
+
+    extern std::atomic<bool> enabledFlag;
+    inline bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+
+    void enable(const QString &path); // Starts recording, path is where writeChromeJson goes by default
+    QString outputPath();
+    void setThreadName(const char *name); // Shows up in the trace viewer instead of a number
+    bool writeChromeJson(const QString &path = QString()); // Everything still in the rings, oldest first. false if it couldn't be written
+
+    qint64 now(); // Nanoseconds since tracing was enabled
+    void record(const char *name, qint64 startNs, qint64 endNs); // Called by Scope
+
+    class Scope {
+        private:
+            const char *name;
+            qint64 start; // -1 while tracing is off
+
+        public:
+            explicit Scope(const char *name) : name(name), start(enabled() ? now() : -1) {}
+            ~Scope() {
+                if (start >= 0)
+                    record(name, start, now());
+            }
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+    };
+}
+
+#define SARI_TRACE_CONCAT_(a, b) a##b
+#define SARI_TRACE_CONCAT(a, b) SARI_TRACE_CONCAT_(a, b)
+#define SARI_TRACE_SCOPE(name) Trace::Scope SARI_TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+#endif // TRACE_H
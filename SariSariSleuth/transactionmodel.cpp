@@ -1,14 +1,18 @@
 #include "transactionmodel.h"
+#include "trace.h"
+#include "metrics.h"
+#include "recordparser.h"
+#include "iothread.h"
+#include "recordframe.h"
 #include <QDebug>
 #include <QDir>
-#include <fstream>
+#include <QFile>
 #include <sstream>
-#include <vector>
 #include <algorithm>
 
 // CONSTRUCTOR
-TransactionModel::TransactionModel(QObject *parent) : QAbstractTableModel(parent), nextTransactionId(1) {
-    readDataFromFile();
+TransactionModel::TransactionModel(QObject *parent) : QAbstractTableModel(parent), writer(DATA_FILE), deadLines(0) {
+    // Starts out empty, MainWindow loads the file on a worker thread (see loadFromDisk)
 }
 
 //NECESSARY OVERRIDES, better explanations exist in the stockmodel.h file since that was created first
@@ -32,8 +36,8 @@ QVariant TransactionModel::data(const QModelIndex &index, int role) const {
         const Transaction &transaction = transactions[index.row()];
         switch (index.column()) {
             case 0: return transaction.transactionId;
-            case 1: return transaction.item.productName;
-            case 2: return QString::number(transaction.item.price, 'f', 2);
+            case 1: return transaction.productName;
+            case 2: return QString::number(transaction.price, 'f', 2);
             case 3: return transaction.quantity;
             case 4: return transaction.timestamp.toString("yyyy-MM-dd hh:mm:ss");
             default: return QVariant();
@@ -62,26 +66,18 @@ QVariant TransactionModel::headerData(int section, Qt::Orientation orientation,
 
 // ACTUAL IMPLEMENTED FUNCTIONS
 void TransactionModel::addTransaction(const StockItem &item, int quantity) {
+    SARI_TRACE_SCOPE("TransactionModel::addTransaction");
     beginInsertRows(QModelIndex(), transactions.size(), transactions.size());
     
     Transaction transaction;
     
-    // Find the first available transaction ID
-    std::vector<int> ids;
-    for (const Transaction& t : transactions) {
-        ids.push_back(t.transactionId);
-    }
-    int newId = 1;
-    for (int i = 0; i < ids.size(); i++) {
-        if(std::find(ids.begin(), ids.end(), newId) != ids.end()) {
-            newId++;
-        } else {
-            break;
-        }
-    }
+    // First available transaction ID
+    int newId = ids.allocate();
     
     transaction.transactionId = newId;
-    transaction.item = item;
+    transaction.itemId = item.id;
+    transaction.productName = item.productName;
+    transaction.price = item.price;
     transaction.quantity = quantity;
     transaction.timestamp = QDateTime::currentDateTime();
     
@@ -98,126 +94,233 @@ Transaction TransactionModel::getTransaction(int row) const {
 
 void TransactionModel::removeTransaction(int row) {
 
-    // Called by onConfirmTransactionClicked and onDeleteTransactionClicked
+    // Called by onDeleteTransactionClicked
 
     if (row >= 0 && row < transactions.size()) {
-        beginRemoveRows(QModelIndex(), row, row);
-        deleteTransactionFromFile(transactions.at(row).transactionId);
-        transactions.removeAt(row);
+        removeTransactions({row});
+    }
+}
+
+bool TransactionModel::removeTransactions(QVector<int> rows, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("TransactionModel::removeTransactions");
+
+    // Called by removeTransaction and InventoryService::confirmPending
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    QSet<int> removedIds;
+    for (int row : rows) {
+        if (row < 0 || row >= transactions.size()) // Guard
+            return false;
+        removedIds.insert(transactions.at(row).transactionId);
+    }
+    if (rows.isEmpty())
+        return true;
+
+    if (!appendTombstones(removedIds))
+        return false;
+    if (written)
+        written->push_back(writer.lastWriteCompletion());
+
+    // Back to front so the rows still to go keep their numbers, one signal per run of adjacent rows
+    int last = rows.size() - 1;
+    while (last >= 0) {
+        int first = last;
+        while (first > 0 && rows[first - 1] == rows[first] - 1) {
+            first--;
+        }
+        beginRemoveRows(QModelIndex(), rows[first], rows[last]);
+        for (int i = rows[last]; i >= rows[first]; i--) {
+            ids.release(transactions.at(i).transactionId);
+        }
+        transactions.remove(rows[first], rows[last] - rows[first] + 1);
         endRemoveRows();
+        last = first - 1;
+    }
+
+    if (deadLines > transactions.size() && deadLines >= COMPACT_MIN_DEAD_LINES) {
+        compactFile();
     }
+    return true;
 }
 
 void TransactionModel::clearTransactions() { // TODO: WHERE????
+    SARI_TRACE_SCOPE("TransactionModel::clearTransactions");
+    writer.close();
+    IoThread::instance().barrier().wait(); // Nothing queued may land in a file restored after this
     beginResetModel();
     transactions.clear();
-    nextTransactionId = 1;
+    ids.clear();
+    deadLines = 0;
     endResetModel();
 }
 
+// Formats a transaction the same way it is laid out in pending_transactions.txt:
+// "id|item id|name|price|quantity|timestamp". Files from before also have the item's stock, remaining
+// and sold after the price, which were never read back
+static std::string formatTransaction(const Transaction &transaction) {
+    std::ostringstream oss;
+    oss << transaction.transactionId << "|"
+        << transaction.itemId << "|"
+        << transaction.productName.toStdString() << "|"
+        << transaction.price << "|"
+        << transaction.quantity << "|"
+        << transaction.timestamp.toString("yyyy-MM-dd hh:mm:ss").toStdString();
+    return oss.str();
+}
+
 void TransactionModel::writeTransactionToFile(const Transaction &transaction) {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ofstream file(DATA_FILE.toStdString(), std::ios::app);
-    if (file.is_open()) {
-        file << transaction.transactionId << "|"
-             << transaction.item.id << "|"
-             << transaction.item.productName.toStdString() << "|"
-             << transaction.item.price << "|"
-             << transaction.item.stock << "|"
-             << transaction.item.remaining << "|"
-             << transaction.item.sold << "|"
-             << transaction.quantity << "|"
-             << transaction.timestamp.toString("yyyy-MM-dd hh:mm:ss").toStdString() << std::endl;
-        file.close();
+    SARI_TRACE_SCOPE("TransactionModel::writeTransactionToFile");
+    std::string line = frameRecord(formatTransaction(transaction));
+    if (!writer.write(line.data(), qint64(line.size()))) {
+        qWarning() << "Failed to save pending transaction" << transaction.transactionId;
     }
 }
 
-void TransactionModel::deleteTransactionFromFile(int id) {
-    std::ifstream inFile(DATA_FILE.toStdString());
-    std::ofstream outFile("Data/temp.txt");
-    std::string line;
-    bool found = false;
-    
-    if (inFile.is_open() && outFile.is_open()) {
-        while (std::getline(inFile, line)) {
-            std::istringstream iss(line);
-            std::string idStr;
-            std::getline(iss, idStr, '|');
-            int currentId = std::stoi(idStr);
-            
-            if (currentId != id) {
-                outFile << line << std::endl;
-            } else {
-                found = true;
-            }
-        }
-        
-        inFile.close();
-        outFile.close();
-        
-        if (found) {
-            // Replace the original file with the temporary file
-            std::remove(DATA_FILE.toStdString().c_str());
-            std::rename("Data/temp.txt", DATA_FILE.toStdString().c_str());
-        } else {
-            // If item wasn't found, remove the temporary file
-            std::remove("Data/temp.txt");
-        }
+bool TransactionModel::appendTombstones(const QSet<int> &removedIds) {
+    SARI_TRACE_SCOPE("TransactionModel::appendTombstones");
+
+    // Called by removeTransactions, the file only gets rewritten once enough of these pile up (see compactFile)
+
+    std::string records;
+    for (int id : removedIds) {
+        records += frameRecord("-" + std::to_string(id));
     }
+
+    if (!writer.write(records.data(), qint64(records.size()))) // Either all of them or none
+        return false;
+    deadLines += 2 * removedIds.size(); // The tombstone and the line it cancels
+    return true;
 }
 
-void TransactionModel::readDataFromFile() {
-    // Create Data directory if it doesn't exist
-    QDir().mkpath("Data");
-    
-    std::ifstream file(DATA_FILE.toStdString());
-    if (!file.is_open()) {
-        return; // File doesn't exist yet, that's okay
+bool TransactionModel::restoreTransactions(const QVector<int> &rows, const QVector<Transaction> &removed, WriteCompletions *written) {
+    SARI_TRACE_SCOPE("TransactionModel::restoreTransactions");
+
+    // Called by InventoryService to roll back a confirm whose tombstones didn't make it.
+    // The records go in again whether or not the tombstones did, the newer of two records with the same id wins
+    // when the file is read back, and a compaction queued after the tombstones is undone the same way
+
+    std::string records;
+    for (const Transaction &transaction : removed) {
+        records += frameRecord(formatTransaction(transaction));
     }
+    if (!writer.write(records.data(), qint64(records.size())))
+        return false;
+    if (written)
+        written->push_back(writer.lastWriteCompletion());
 
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string thing;
-        Transaction transaction;
+    for (int i = 0; i < removed.size(); i++) { // Ascending, so every row lands where it was before
+        const int row = std::min(rows[i], int(transactions.size()));
+        beginInsertRows(QModelIndex(), row, row);
+        transactions.insert(row, removed[i]);
+        ids.reserve(removed[i].transactionId);
+        endInsertRows();
+    }
+    return true;
+}
 
-        // Read Transaction ID
-        std::getline(iss, thing, '|');
-        transaction.transactionId = std::stoi(thing);
-        nextTransactionId = std::max(nextTransactionId, transaction.transactionId + 1);
+void TransactionModel::compactFile() {
+    SARI_TRACE_SCOPE("TransactionModel::compactFile");
 
-        // Read StockItem data
-        std::getline(iss, thing, '|');
-        transaction.item.id = std::stoi(thing);
+    // Called by removeTransactions and readDataFromFile once there's more dead than live in the file
 
-        std::getline(iss, thing, '|');
-        transaction.item.productName = QString::fromStdString(thing);
+    QByteArray contents;
+    for (const Transaction &transaction : transactions) {
+        const std::string line = frameRecord(formatTransaction(transaction));
+        contents.append(line.data(), int(line.size()));
+    }
 
-        std::getline(iss, thing, '|');
-        transaction.item.price = std::stod(thing);
+    // Queued behind every append so far, and the I/O thread does it through replaceFileDurably: its own uniquely
+    // named temporary file next to DATA_FILE, synced and renamed over. Nothing else writing a temporary
+    // file in Data can get in the way, and if it fails the old file with its tombstones is still right
+    IoThread::instance().replace(DATA_FILE, contents);
+    deadLines = 0;
+}
 
-        std::getline(iss, thing, '|');
-        transaction.item.stock = std::stoi(thing);
+void TransactionModel::readDataFromFile() {
+    SARI_TRACE_SCOPE("TransactionModel::readDataFromFile");
 
-        std::getline(iss, thing, '|');
-        transaction.item.remaining = std::stoi(thing);
+    // Called by the restore, startup goes through loadFromDisk on a worker and applyLoaded instead
 
-        std::getline(iss, thing, '|');
-        transaction.item.sold = std::stoi(thing);
+    // Create Data directory if it doesn't exist
+    QDir().mkpath("Data");
+    writer.close();
+    IoThread::instance().barrier().wait(); // Every append queued so far is in the file
+    applyLoaded(loadFromDisk());
+}
+
+TransactionModel::LoadResult TransactionModel::loadFromDisk() const {
+    SARI_TRACE_SCOPE("TransactionModel::loadFromDisk");
+    Metrics::ScopedTimer timer(Metrics::loadPending);
+    LoadResult result;
 
-        // Read Quantity
-        std::getline(iss, thing, '|');
-        transaction.quantity = std::stoi(thing);
+    // Ids get reused, so a tombstone only cancels the record for that id that came before it
+    QVector<Transaction> loaded;
+    QVector<bool> live;
+    QHash<int, int> latest; // id -> position in loaded of the record that still stands
+    int tombstones = 0;
 
-        // Read Timestamp
-        std::getline(iss, thing, '|');
-        transaction.timestamp = QDateTime::fromString(QString::fromStdString(thing), "yyyy-MM-dd hh:mm:ss");
+    // File doesn't exist yet, that's okay
+    forEachRecord(DATA_FILE, [&](RecordParser &fields, std::string_view line) {
+        Transaction transaction;
+        if (!fields.nextInt(transaction.transactionId)) // Read Transaction ID
+            return false;
 
-        // Add to transactions list
-        transactions.append(transaction);
+        if (transaction.transactionId < 0) { // Tombstone, "-id" and nothing else
+            if (!fields.atEnd())
+                return false;
+            auto it = latest.find(-transaction.transactionId);
+            if (it != latest.end()) {
+                live[it.value()] = false;
+                latest.erase(it);
+            }
+            tombstones++;
+            return true;
+        }
+
+        bool ok = fields.nextInt(transaction.itemId) // Read item data
+            && fields.nextString(transaction.productName)
+            && fields.nextDouble(transaction.price);
+        if (ok && std::count(line.begin(), line.end(), '|') == 8) { // Old layout, skip stock, remaining and sold
+            std::string_view skipped;
+            ok = fields.next(skipped) && fields.next(skipped) && fields.next(skipped);
+        }
+        ok = ok && fields.nextInt(transaction.quantity) // Read Quantity
+            && fields.nextTimestamp(transaction.timestamp); // Read Timestamp
+        if (!ok)
+            return false;
+
+        auto it = latest.find(transaction.transactionId);
+        if (it != latest.end()) { // Same id twice without a tombstone in between, the newer one wins
+            live[it.value()] = false;
+        }
+        latest.insert(transaction.transactionId, loaded.size());
+        loaded.append(transaction);
+        live.append(true);
+        return true;
+    });
+
+    for (int i = 0; i < loaded.size(); i++) {
+        if (live[i]) {
+            result.transactions.append(loaded[i]);
+        }
     }
+    result.deadLines = tombstones + loaded.size() - result.transactions.size();
+    return result;
+}
 
-    file.close();
+void TransactionModel::applyLoaded(const LoadResult &loaded) {
+    SARI_TRACE_SCOPE("TransactionModel::applyLoaded");
+    beginResetModel();
+    transactions = loaded.transactions;
+    ids.clear();
+    for (const Transaction &transaction : transactions) {
+        ids.reserve(transaction.transactionId);
+    }
+    deadLines = loaded.deadLines;
+    endResetModel();
+
+    if (deadLines > transactions.size() && deadLines >= COMPACT_MIN_DEAD_LINES) {
+        compactFile();
+    }
 }
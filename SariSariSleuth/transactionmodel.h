@@ -4,17 +4,24 @@
 #include <QAbstractTableModel>
 #include <QVector>
 #include <QDateTime>
+#include <QSet>
 #include "stockmodel.h"
+#include "idallocator.h"
+#include "recordwriter.h"
 
 struct Transaction { // Our transaction data structure
     int transactionId;
-    StockItem item;
+    int itemId;
+    QString productName; // Shared with the stock item's, not a copy
+    double price; // Unit price when the transaction was added
     int quantity;
     QDateTime timestamp;
 
     bool operator==(const Transaction &other) const {
         return transactionId == other.transactionId &&
-               item == other.item &&
+               itemId == other.itemId &&
+               productName == other.productName &&
+               price == other.price &&
                quantity == other.quantity &&
                timestamp == other.timestamp;
     }
@@ -25,16 +32,28 @@ class TransactionModel : public QAbstractTableModel {
 
     private:
         QVector<Transaction> transactions; //Our list of transactions
-        int nextTransactionId;
-        const QString DATA_FILE = "Data/pending_transactions.txt";
+        IdAllocator ids; // Free transaction ids, lowest first
+        const QString DATA_FILE = "Data/pending_transactions.txt"; // Transactions, and "-id" tombstones for removed ones
+        RecordWriter writer; // Appends to DATA_FILE through the I/O thread
+        int deadLines; // Lines in DATA_FILE that don't make a pending transaction anymore, tombstones included
+        static const int COMPACT_MIN_DEAD_LINES = 64; // Compact once dead lines outnumber live ones, but not before this many
 
         // Helper functions for file operations
         void writeTransactionToFile(const Transaction &transaction);
-        void deleteTransactionFromFile(int id);
+        bool appendTombstones(const QSet<int> &removedIds); // One small append, however many there are
+        void compactFile(); // Rewrites DATA_FILE with just the pending transactions, on the I/O thread
 
     public:
         explicit TransactionModel(QObject *parent = nullptr); //Constructor
-        void readDataFromFile();
+        void readDataFromFile(); // Reads the file again right here, e.g. after a restore
+
+        // Loading split in two, so the slow part can run on a worker while the model sits empty
+        struct LoadResult {
+            QVector<Transaction> transactions; // Tombstoned ones already dropped
+            int deadLines = 0;
+        };
+        LoadResult loadFromDisk() const; // Only reads the file, safe off the GUI thread
+        void applyLoaded(const LoadResult &loaded); // GUI thread, replaces whatever the model had
 
     // Required overrides for QAbstractTableModel
         int rowCount(const QModelIndex &parent = QModelIndex()) const override;
@@ -46,6 +65,9 @@ class TransactionModel : public QAbstractTableModel {
         void addTransaction(const StockItem &item, int quantity);
         Transaction getTransaction(int row) const;
         void removeTransaction(int row);
+        bool removeTransactions(QVector<int> rows, WriteCompletions *written = nullptr); // One append of tombstones, added to written
+        // Puts back what removeTransactions took out, removed[i] at rows[i] with rows in ascending order. Same for written
+        bool restoreTransactions(const QVector<int> &rows, const QVector<Transaction> &removed, WriteCompletions *written = nullptr);
         void clearTransactions();
 };
 
@@ -0,0 +1,78 @@
+#include "trigramindex.h"
+
+QString TrigramIndex::fold(const QString &text) {
+    return text.toCaseFolded();
+}
+
+quint64 TrigramIndex::trigramAt(const QString &text, int i) {
+    return (quint64(text[i].unicode()) << 32) | (quint64(text[i + 1].unicode()) << 16) | quint64(text[i + 2].unicode());
+}
+
+void TrigramIndex::clear() {
+    postings.clear();
+    foldedNames.clear();
+}
+
+void TrigramIndex::insert(int id, const QString &name) {
+    const QString folded = fold(name);
+    foldedNames.insert(id, folded);
+    for (int i = 0; i + 2 < folded.size(); i++) {
+        postings[trigramAt(folded, i)].insert(id);
+    }
+}
+
+void TrigramIndex::remove(int id) {
+    auto it = foldedNames.find(id);
+    if (it == foldedNames.end())
+        return;
+
+    const QString folded = it.value();
+    for (int i = 0; i + 2 < folded.size(); i++) {
+        auto posting = postings.find(trigramAt(folded, i));
+        if (posting != postings.end()) {
+            posting->remove(id);
+            if (posting->isEmpty())
+                postings.erase(posting);
+        }
+    }
+    foldedNames.erase(it);
+}
+
+QVector<int> TrigramIndex::candidates(const QString &foldedQuery) const {
+    // Gather the posting list of every trigram in the query, one missing trigram means no match at all
+    QVector<const QSet<int> *> lists;
+    for (int i = 0; i + 2 < foldedQuery.size(); i++) {
+        auto posting = postings.constFind(trigramAt(foldedQuery, i));
+        if (posting == postings.constEnd())
+            return QVector<int>();
+        lists.append(&posting.value());
+    }
+    if (lists.isEmpty())
+        return QVector<int>();
+
+    // Walk the smallest list and probe the others
+    const QSet<int> *smallest = lists[0];
+    for (const QSet<int> *list : lists) {
+        if (list->size() < smallest->size())
+            smallest = list;
+    }
+
+    QVector<int> result;
+    for (int id : *smallest) {
+        bool inAll = true;
+        for (const QSet<int> *list : lists) {
+            if (list != smallest && !list->contains(id)) {
+                inAll = false;
+                break;
+            }
+        }
+        if (inAll)
+            result.append(id);
+    }
+    return result;
+}
+
+bool TrigramIndex::matches(int id, const QString &foldedQuery) const {
+    auto it = foldedNames.constFind(id);
+    return it != foldedNames.constEnd() && it.value().contains(foldedQuery);
+}
@@ -0,0 +1,32 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+// Trigram index over case-folded product names, keyed by item id.
+// Every 3 character window of a name points back at the items that contain it, so a
+// query only has to look at the items that have all of its trigrams.
+class TrigramIndex {
+    private:
+        QHash<quint64, QSet<int>> postings; // trigram -> ids of the names containing it
+        QHash<int, QString> foldedNames; // id -> case-folded name
+
+        static quint64 trigramAt(const QString &text, int i); // Packs text[i..i+2] into one key
+
+    public:
+        static QString fold(const QString &text); // What names and queries are compared as
+
+        void clear();
+        void insert(int id, const QString &name);
+        void remove(int id);
+
+        // Ids whose names have every trigram of the (folded, at least 3 long) query.
+        // Having all the trigrams doesn't guarantee a substring match, so check with matches().
+        QVector<int> candidates(const QString &foldedQuery) const;
+        bool matches(int id, const QString &foldedQuery) const;
+};
+
+#endif // TRIGRAMINDEX_H